@@ -15,6 +15,48 @@ namespace CameraReceiver
         public bool IsInitialized => _isInitialized;
         public bool IsStarted => _isStarted;
 
+        /// <summary>
+        /// Передавать JPEG телефона в камеру без декодирования (формат MJPG),
+        /// пока все запущенные пины берут MJPG; иначе кадры декодируются
+        /// </summary>
+        public bool JpegPassthrough
+        {
+            get => _shmClient.JpegPassthrough;
+            set => _shmClient.JpegPassthrough = value;
+        }
+
+        /// <summary>
+        /// Выделять слоты кадров на больших страницах (применяется при подключении)
+        /// </summary>
+        public bool UseLargePages
+        {
+            get => _shmClient.UseLargePages;
+            set => _shmClient.UseLargePages = value;
+        }
+
+        /// <summary>
+        /// Не декодировать и не публиковать кадры, пока камеру никто не открыл
+        /// </summary>
+        public bool IdleWithoutReaders
+        {
+            get => _shmClient.IdleWithoutReaders;
+            set => _shmClient.IdleWithoutReaders = value;
+        }
+
+        /// <summary>
+        /// Уменьшать кадры до наибольшего размера, запрошенного приложениями
+        /// </summary>
+        public bool PublishAtDemandedSize
+        {
+            get => _shmClient.PublishAtDemandedSize;
+            set => _shmClient.PublishAtDemandedSize = value;
+        }
+
+        /// <summary>
+        /// Сколько приложений сейчас забирают кадры из виртуальной камеры
+        /// </summary>
+        public int ActiveReaders => _isStarted ? _shmClient.ActiveReaders : 0;
+
         /// <summary>
         /// Получает ширину кадра от TCP клиента
         /// </summary>
@@ -1,4 +1,6 @@
 using System;
+using System.Collections.Generic;
+using System.Diagnostics;
 using System.Drawing;
 using System.Drawing.Imaging;
 using System.IO;
@@ -6,30 +8,307 @@ using System.IO.MemoryMappedFiles;
 using System.Runtime.InteropServices;
 using System.Threading;
 using System.Threading.Tasks;
+using Microsoft.Win32.SafeHandles;
 
 namespace CameraReceiver
 {
     public class VirtualCameraSharedMemClient : IDisposable
     {
         private const string SHM_NAME = "Global\\vCamShm";
+        // События «вышел новый кадр»: у каждого читателя своё, создаёт его
+        // фильтр с именем по pid и номеру записи в таблице читателей
+        // (VCAM_EVENT_FORMAT в SharedMem.h). Общее авто-сбрасываемое будило
+        // бы только один процесс из нескольких.
+        private const string EVENT_NAME_PREFIX = "Global\\vCamFrameEvent";
+        // Размер по умолчанию; кадры крупнее слота уменьшаются до него
         private const int FRAME_W = 1920;
         private const int FRAME_H = 1080;
         private const int BYTES_PER_PIXEL = 3; // BGR24
-        private const int FRAME_SZ = FRAME_W * FRAME_H * BYTES_PER_PIXEL; // 6 220 800
-        private const int HEADER_SZ = 12; // int frameId + uint dataSize
-        private const int TOTAL_SZ = HEADER_SZ + 2 * FRAME_SZ;
+        // Слоты начинаются с границы страницы и занимают целое число страниц
+        private const int PAGE_SZ = 4096;
+        private const int SLOT_SZ = (FRAME_W * FRAME_H * BYTES_PER_PIXEL + PAGE_SZ - 1) / PAGE_SZ * PAGE_SZ; // 6 221 824 — ёмкость слота
+        // Раскладка заголовка совпадает с SharedHeader в VirtualCamFilter/SharedMem.h.
+        // Поля, которые пишет фильтр (счётчики читателей), лежат в других
+        // строках кэша (64 байта), чем поля писателя.
+        private const uint SHM_MAGIC = (uint)('v' | ('C' << 8) | ('a' << 16) | ('m' << 24));
+        private const uint SHM_VERSION = 6;
+        public const int MIN_SLOTS = 3;
+        public const int MAX_SLOTS = 8;
+        public const int MAX_READERS = 16;
+        // Строка 0: описание раскладки
+        private const int OFF_MAGIC = 0;
+        private const int OFF_VERSION = 4;
+        private const int OFF_SLOT_COUNT = 8;
+        private const int OFF_SLOT_SIZE = 12;
+        private const int OFF_DATA_OFFSET = 16;
+        // Строка 1: публикация кадра
+        private const int OFF_FRAME_ID = 64;
+        private const int OFF_CURRENT = 68;
+        private const int OFF_SLOTS = 128;    // SharedSlot[MAX_SLOTS] по 128 байт
+        // Поля SharedSlot: первая строка пишет писатель, вторая — фильтр
+        private const int SLOT_SEQ = 0;
+        private const int SLOT_FRAME_ID = 4;
+        private const int SLOT_FOURCC = 8;
+        private const int SLOT_WIDTH = 12;
+        private const int SLOT_HEIGHT = 16;
+        private const int SLOT_STRIDE = 20;
+        private const int SLOT_SIZE = 24;
+        private const int SLOT_READERS = 64;
+        private const int SLOT_CTRL_SZ = 128;
+        private const int OFF_READERS = OFF_SLOTS + MAX_SLOTS * SLOT_CTRL_SZ; // SharedReader[MAX_READERS] по 64 байта
+        // Поля SharedReader: запись пишет только её владелец-фильтр
+        private const int READER_PID = 0;
+        private const int READER_LAST_FRAME = 4;
+        private const int READER_HEARTBEAT = 8;   // GetTickCount64 последнего кадра, 8 байт
+        private const int READER_FOURCC = 16;
+        private const int READER_WIDTH = 20;
+        private const int READER_HEIGHT = 24;
+        private const int READER_STREAMING = 28;  // 1 — граф пина запущен
+        private const int READER_PINS = 32;       // int[MAX_SLOTS]
+        private const int READER_SZ = 64;
+        private const int HEADER_SZ = OFF_READERS + MAX_READERS * READER_SZ; // 2176
+        // Читатель, не обновлявший запись дольше этого, считается неактивным
+        // (SHM_READER_TIMEOUT_MS в SharedMem.h)
+        private const long READER_TIMEOUT_MS = 2000;
+        private const int DATA_OFFSET = (HEADER_SZ + PAGE_SZ - 1) / PAGE_SZ * PAGE_SZ; // 4096
+
+        // Формат кадра в слоте (SHM_FOURCC_* в SharedMem.h)
+        private const uint FOURCC_BGR24 = (uint)('B' | ('G' << 8) | ('R' << 16) | ('3' << 24));
+        private const uint FOURCC_NV12 = (uint)('N' | ('V' << 8) | ('1' << 16) | ('2' << 24));
+        private const uint FOURCC_I420 = (uint)('I' | ('4' << 8) | ('2' << 16) | ('0' << 24));
+        private const uint FOURCC_MJPG = (uint)('M' | ('J' << 8) | ('P' << 16) | ('G' << 24));
+
+        private readonly int _slotCount;
+        private long TotalSize => DATA_OFFSET + (long)_slotCount * SLOT_SZ;
+        // Размер секции: TotalSize, для больших страниц — с округлением до них
+        private long _mappedSize;
 
         private MemoryMappedFile? _mmf;
+        // Секция на больших страницах создаётся через WinAPI (MemoryMappedFile
+        // так не умеет); дескриптор держим, пока секция открыта
+        private SafeMemoryMappedFileHandle? _largePageSection;
+        private bool _largePages;
         private MemoryMappedViewAccessor? _accessor;
+        // Открытые события читателей и pid, для которого открыто каждое.
+        // Для неудачной попытки — pid и был ли у записи heartbeat в тот момент.
+        private readonly EventWaitHandle?[] _readerEvents = new EventWaitHandle?[MAX_READERS];
+        private readonly int[] _readerEventPids = new int[MAX_READERS];
+        private readonly bool[] _readerEventFailed = new bool[MAX_READERS];
+        private readonly bool[] _readerEventFailedLive = new bool[MAX_READERS];
         private int _frameId = 0;
         private bool _isConnected = false;
 
         public event EventHandler<string>? StatusChanged;
         public event EventHandler<string>? ErrorOccurred;
 
+        private int _droppedFrames = 0;
+        private int _idleFrames = 0;
+        private bool _idle = false;
+        private bool _jpegPassthroughActive = false;
+        private (int Width, int Height) _demand;
+
         public bool IsConnected => _isConnected;
+        public int SlotCount => _slotCount;
+        public int DroppedFrames => _droppedFrames;
+        // Кадры, пропущенные без декодирования, пока камеру никто не открыл
+        public int IdleFrames => _idleFrames;
         public int FrameWidth => FRAME_W;
         public int FrameHeight => FRAME_H;
+        public bool LargePagesActive => _largePages;
+
+        // JPEG телефона кладётся в слот как есть, без декодирования, если
+        // каждый запущенный пин договорился о MJPG. Иначе кадр декодируется,
+        // как без этого флага: пины YUY2/NV12/I420/RGB24 JPEG не разберут.
+        public bool JpegPassthrough { get; set; }
+
+        // Пока ни одно приложение не забирает кадры из камеры, входящие кадры
+        // не декодируются и не публикуются. Фильтр отмечает запуск графа в
+        // таблице читателей до первого кадра, так что публикация
+        // возобновляется со следующего кадра телефона.
+        public bool IdleWithoutReaders { get; set; } = true;
+
+        // Публиковать кадры не больше, чем просят запущенные пины: если все
+        // приложения взяли 640x480, кадр телефона 16:9 сразу уменьшается до
+        // 640x360, и ни перевод в BGR24, ни копирование в слот, ни фильтр не
+        // работают с полным размером.
+        public bool PublishAtDemandedSize { get; set; } = true;
+
+        // Выделять слоты на больших страницах (2 МБ): фильтр проходит 6 МБ
+        // кадра на каждой конвертации, и на обычных страницах это полторы
+        // тысячи промахов TLB. Нужна привилегия «Блокировка страниц в памяти»
+        // (SeLockMemoryPrivilege); без неё — обычные страницы. Читается при
+        // подключении; по умолчанию — из переменной окружения VCAM_LARGE_PAGES=1.
+        public bool UseLargePages { get; set; } = Environment.GetEnvironmentVariable("VCAM_LARGE_PAGES") == "1";
+
+        public VirtualCameraSharedMemClient(int slotCount = MIN_SLOTS)
+        {
+            _slotCount = Math.Clamp(slotCount, MIN_SLOTS, MAX_SLOTS);
+        }
+
+        private static int SlotOffset(int slot, int field) => OFF_SLOTS + slot * SLOT_CTRL_SZ + field;
+        private static int ReaderOffset(int reader, int field) => OFF_READERS + reader * READER_SZ + field;
+
+        // Состояние одного читателя (пина фильтра в каком-то приложении)
+        public readonly record struct ReaderInfo(int ProcessId, bool Streaming, int LagFrames, long IdleMs,
+                                                 uint FourCC, int Width, int Height)
+        {
+            public bool IsActive => Streaming && IdleMs < READER_TIMEOUT_MS;
+        }
+
+        // Читатели из таблицы в shared memory: кто подключён, насколько
+        // отстаёт от последнего опубликованного кадра и в каком формате берёт кадры
+        public ReaderInfo[] GetReaders()
+        {
+            var accessor = _accessor;
+            if (!_isConnected || accessor == null)
+                return Array.Empty<ReaderInfo>();
+
+            var readers = new List<ReaderInfo>();
+            long now = Environment.TickCount64;
+            int published = accessor.ReadInt32(OFF_FRAME_ID);
+            for (int i = 0; i < MAX_READERS; i++)
+            {
+                int pid = accessor.ReadInt32(ReaderOffset(i, READER_PID));
+                if (pid == 0)
+                    continue;
+                long heartbeat = accessor.ReadInt64(ReaderOffset(i, READER_HEARTBEAT));
+                readers.Add(new ReaderInfo(
+                    pid,
+                    accessor.ReadInt32(ReaderOffset(i, READER_STREAMING)) != 0,
+                    published - accessor.ReadInt32(ReaderOffset(i, READER_LAST_FRAME)),
+                    heartbeat == 0 ? long.MaxValue : Math.Max(0, now - heartbeat),
+                    accessor.ReadUInt32(ReaderOffset(i, READER_FOURCC)),
+                    accessor.ReadInt32(ReaderOffset(i, READER_WIDTH)),
+                    accessor.ReadInt32(ReaderOffset(i, READER_HEIGHT))));
+            }
+            return readers.ToArray();
+        }
+
+        public int ActiveReaders
+        {
+            get
+            {
+                int active = 0;
+                foreach (var reader in GetReaders())
+                    if (reader.IsActive)
+                        active++;
+                return active;
+            }
+        }
+
+        // Запись читателя занята запущенным пином со свежим heartbeat — то
+        // же, что ShmReaderActive в SharedMem.h
+        private bool ReaderActive(int reader, long now)
+        {
+            var accessor = _accessor!;
+            if (accessor.ReadInt32(ReaderOffset(reader, READER_PID)) == 0 ||
+                accessor.ReadInt32(ReaderOffset(reader, READER_STREAMING)) == 0)
+                return false;
+            long heartbeat = accessor.ReadInt64(ReaderOffset(reader, READER_HEARTBEAT));
+            return heartbeat != 0 && now - heartbeat < READER_TIMEOUT_MS;
+        }
+
+        // Есть ли хоть один запущенный пин — ShmActiveReaders в SharedMem.h.
+        // Вызывается на каждый кадр, поэтому без выделений памяти.
+        private bool AnyReaderStreaming()
+        {
+            long now = Environment.TickCount64;
+            for (int i = 0; i < MAX_READERS; i++)
+            {
+                if (ReaderActive(i, now))
+                    return true;
+            }
+            return false;
+        }
+
+        // Наибольший размер, о котором договорились запущенные пины, ширина и
+        // высота по отдельности — ShmDemand в SharedMem.h: прямоугольник, в
+        // который помещается кадр любого пина. (0, 0) — запросов нет.
+        private (int Width, int Height) DemandedSize()
+        {
+            var accessor = _accessor!;
+            long now = Environment.TickCount64;
+            int width = 0, height = 0;
+            for (int i = 0; i < MAX_READERS; i++)
+            {
+                if (!ReaderActive(i, now))
+                    continue;
+                width = Math.Max(width, accessor.ReadInt32(ReaderOffset(i, READER_WIDTH)));
+                height = Math.Max(height, accessor.ReadInt32(ReaderOffset(i, READER_HEIGHT)));
+            }
+
+            if ((width, height) != _demand)
+            {
+                _demand = (width, height);
+                if (width > 0 && height > 0)
+                    OnStatusChanged($"Приложения запрашивают кадры до {width}x{height}");
+            }
+            return (width, height);
+        }
+
+        // Размер, в котором публикуется кадр width x height: он равномерно
+        // уменьшается, пока не поместится в запрошенный пинами прямоугольник
+        // и в слот, и никогда не увеличивается. Пропорции сохраняются, до
+        // размера пина кадр доводит масштабирование фильтра. Стороны
+        // уменьшенного кадра чётные, как у выходных кадров 4:2:0.
+        private (int Width, int Height) PublishSize(int width, int height)
+        {
+            double scale = 1.0;
+            if (PublishAtDemandedSize)
+            {
+                var (demandW, demandH) = DemandedSize();
+                if (demandW > 0 && demandH > 0)
+                    scale = Math.Min(scale, Math.Min((double)demandW / width, (double)demandH / height));
+            }
+            long bytes = (long)width * height * BYTES_PER_PIXEL;
+            if (bytes > SLOT_SZ)
+                scale = Math.Min(scale, Math.Sqrt((double)SLOT_SZ / bytes));
+            if (scale >= 1.0)
+                return (width, height);
+
+            // Поправка на погрешность: 1920 * (1280 / 1920.0) не должно стать 1279
+            int w = Math.Max(2, (int)(width * scale + 1e-6) & ~1);
+            int h = Math.Max(2, (int)(height * scale + 1e-6) & ~1);
+            return (w, h);
+        }
+
+        // JPEG можно публиковать как есть, только если его заберут все:
+        // каждый запущенный пин просит MJPG. Пока запущенных пинов нет, JPEG
+        // тоже публикуется — по нему фильтр предлагает MJPG приложениям.
+        private bool AllReadersTakeJpeg()
+        {
+            var accessor = _accessor!;
+            long now = Environment.TickCount64;
+            bool all = true;
+            for (int i = 0; i < MAX_READERS && all; i++)
+            {
+                if (ReaderActive(i, now) && accessor.ReadUInt32(ReaderOffset(i, READER_FOURCC)) != FOURCC_MJPG)
+                    all = false;
+            }
+
+            if (all != _jpegPassthroughActive)
+            {
+                _jpegPassthroughActive = all;
+                OnStatusChanged(all ? "Все приложения берут MJPG — JPEG публикуется без декодирования"
+                                    : "Не все приложения берут MJPG — кадры декодируются");
+            }
+            return all;
+        }
+
+        // true — кадр можно пропустить целиком: его никто не заберёт
+        private bool SkipWhileIdle()
+        {
+            bool idle = IdleWithoutReaders && !AnyReaderStreaming();
+            if (idle != _idle)
+            {
+                _idle = idle;
+                OnStatusChanged(idle ? "Камеру никто не открыл — кадры не публикуются"
+                                     : "Камеру открыли — публикация кадров возобновлена");
+            }
+            if (idle)
+                Interlocked.Increment(ref _idleFrames);
+            return idle;
+        }
 
         public Task<bool> ConnectAsync()
         {
@@ -40,23 +319,56 @@ namespace CameraReceiver
                 {
                     try { _accessor?.Dispose(); } catch { }
                     try { _mmf?.Dispose(); } catch { }
+                    try { _largePageSection?.Dispose(); } catch { }
                     _mmf = null;
                     _accessor = null;
+                    _largePageSection = null;
                     GC.Collect(); // Дополнительная гарантия освобождения ресурсов
                     GC.WaitForPendingFinalizers();
                 }
 
-                // Явно указываем размер и перезаписываем, если существует
-                _mmf = MemoryMappedFile.CreateOrOpen(SHM_NAME, TOTAL_SZ, MemoryMappedFileAccess.ReadWrite);
-                _accessor = _mmf.CreateViewAccessor(0, TOTAL_SZ, MemoryMappedFileAccess.ReadWrite);
+                _largePages = false;
+                _mappedSize = TotalSize;
+                if (UseLargePages)
+                {
+                    string? reason = TryCreateLargePageSection();
+                    if (reason != null)
+                        OnStatusChanged($"Большие страницы недоступны ({reason}), слоты на обычных страницах");
+                }
 
-                // Инициализация с нулями
-                _accessor.Write(0, 0); // frameId = 0
-                _accessor.Write(4, (uint)FRAME_SZ); // dataSize = FRAME_SZ
-                _accessor.Write(8, 0); // currentBuffer = 0 (первый буфер активен)
+                if (_largePageSection != null)
+                {
+                    // Секция уже создана — открываем её по имени
+                    _mmf = MemoryMappedFile.OpenExisting(SHM_NAME, MemoryMappedFileRights.ReadWrite);
+                }
+                else
+                {
+                    // Явно указываем размер и перезаписываем, если существует
+                    _mmf = MemoryMappedFile.CreateOrOpen(SHM_NAME, TotalSize, MemoryMappedFileAccess.ReadWrite);
+                }
+                _accessor = _mmf.CreateViewAccessor(0, _mappedSize, MemoryMappedFileAccess.ReadWrite);
+
+                // Инициализация с нулями. Счётчики читателей не трогаем:
+                // фильтр может уже держать слот.
+                _accessor.Write(OFF_VERSION, 0u); // пока заголовок не готов, фильтр его не читает
+                _accessor.Write(OFF_MAGIC, SHM_MAGIC);
+                _accessor.Write(OFF_SLOT_COUNT, (uint)_slotCount);
+                _accessor.Write(OFF_SLOT_SIZE, (uint)SLOT_SZ);
+                _accessor.Write(OFF_DATA_OFFSET, (uint)DATA_OFFSET);
+                _accessor.Write(OFF_FRAME_ID, 0);
+                _accessor.Write(OFF_CURRENT, 0);
+                for (int i = 0; i < _slotCount; i++)
+                {
+                    _accessor.Write(SlotOffset(i, SLOT_SEQ), 0);
+                    _accessor.Write(SlotOffset(i, SLOT_FRAME_ID), 0);
+                    _accessor.Write(SlotOffset(i, SLOT_FOURCC), 0u); // пусто — фильтр слот не читает
+                }
+                System.Threading.Thread.MemoryBarrier();
+                _accessor.Write(OFF_VERSION, SHM_VERSION);
 
                 _isConnected = true;
-                OnStatusChanged($"Shared memory открыта: {SHM_NAME}, размер {TOTAL_SZ} байт");
+                OnStatusChanged($"Shared memory открыта: {SHM_NAME}, слотов {_slotCount}, размер {_mappedSize} байт" +
+                                (_largePages ? ", большие страницы" : ""));
                 return Task.FromResult(true);
             }
             catch (Exception ex)
@@ -66,6 +378,65 @@ namespace CameraReceiver
             }
         }
 
+        // Создаёт секцию на больших страницах. null — получилось (или секция
+        // уже была создана раньше), иначе причина, по которой не вышло.
+        private string? TryCreateLargePageSection()
+        {
+            long largePage = (long)GetLargePageMinimum();
+            if (largePage == 0)
+                return "процессор не поддерживает";
+            if (!EnableLockMemoryPrivilege())
+                return "нет привилегии SeLockMemoryPrivilege";
+
+            // Размер секции и вида должен быть кратен большой странице
+            long size = (TotalSize + largePage - 1) / largePage * largePage;
+            var section = CreateFileMappingW(INVALID_HANDLE_VALUE, IntPtr.Zero,
+                                             PAGE_READWRITE | SEC_COMMIT | SEC_LARGE_PAGES,
+                                             (uint)(size >> 32), (uint)size, SHM_NAME);
+            int error = Marshal.GetLastWin32Error();
+            if (section.IsInvalid)
+            {
+                section.Dispose();
+                // Обычно ERROR_NO_SYSTEM_RESOURCES: память фрагментирована,
+                // непрерывных 2 МБ не нашлось
+                return $"CreateFileMapping: ошибка {error}";
+            }
+            if (error == ERROR_ALREADY_EXISTS)
+            {
+                // Секцию оставил открытой фильтр от прошлого запуска — её
+                // страницы уже выбраны, работаем с ней как есть
+                section.Dispose();
+                return "секция уже создана на обычных страницах";
+            }
+
+            _largePageSection = section;
+            _mappedSize = size;
+            _largePages = true;
+            return null;
+        }
+
+        // Включает в токене процесса привилегию, без которой большие страницы
+        // не выделяются. Саму привилегию пользователю выдаёт администратор.
+        private static bool EnableLockMemoryPrivilege()
+        {
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, out IntPtr token))
+                return false;
+            try
+            {
+                if (!LookupPrivilegeValueW(null, "SeLockMemoryPrivilege", out long luid))
+                    return false;
+                var tp = new TOKEN_PRIVILEGES { PrivilegeCount = 1, Luid = luid, Attributes = SE_PRIVILEGE_ENABLED };
+                if (!AdjustTokenPrivileges(token, false, ref tp, 0, IntPtr.Zero, IntPtr.Zero))
+                    return false;
+                // Успех AdjustTokenPrivileges не значит, что привилегия есть
+                return Marshal.GetLastWin32Error() != ERROR_NOT_ALL_ASSIGNED;
+            }
+            finally
+            {
+                CloseHandle(token);
+            }
+        }
+
         public async Task<bool> SendFrameAsync(byte[] jpegData)
         {
             if (!_isConnected || _accessor == null || !_accessor.CanWrite)
@@ -83,24 +454,42 @@ namespace CameraReceiver
                 }
             }
 
+            if (SkipWhileIdle())
+                return true;
+
+            if (JpegPassthrough && AllReadersTakeJpeg())
+                return PublishJpeg(jpegData);
+
             try
             {
                 // Конвертация JPEG -> Bitmap
                 using var ms = new MemoryStream(jpegData);
                 using var originalBitmap = new Bitmap(ms);
 
-                // Масштабирование
-                using var resizedBitmap = new Bitmap(FRAME_W, FRAME_H);
-                using (var graphics = Graphics.FromImage(resizedBitmap))
+                // Кадр передаётся в своём размере — до нужного его масштабирует
+                // фильтр. Уменьшаем то, что больше запрошенного запущенными
+                // пинами (они всё равно уменьшили бы его сами), и то, что не
+                // помещается в слот.
+                var (targetW, targetH) = PublishSize(originalBitmap.Width, originalBitmap.Height);
+
+                Bitmap frameBitmap = originalBitmap;
+                Bitmap? resizedBitmap = null;
+                if (targetW != originalBitmap.Width || targetH != originalBitmap.Height)
                 {
-                    graphics.DrawImage(originalBitmap, 0, 0, FRAME_W, FRAME_H);
+                    resizedBitmap = new Bitmap(targetW, targetH);
+                    using (var graphics = Graphics.FromImage(resizedBitmap))
+                    {
+                        graphics.DrawImage(originalBitmap, 0, 0, targetW, targetH);
+                    }
+                    frameBitmap = resizedBitmap;
                 }
 
-                byte[] imageData = ConvertToBGR24(resizedBitmap);
-
-                if (imageData.Length != FRAME_SZ)
+                int width = frameBitmap.Width;
+                int height = frameBitmap.Height;
+                byte[] imageData;
+                using (resizedBitmap)
                 {
-                    throw new InvalidOperationException($"Размер кадра {imageData.Length}, ожидается {FRAME_SZ}");
+                    imageData = ConvertToBGR24(frameBitmap);
                 }
 
                 //// Сначала записываем данные кадра (чтобы избежать гонки условий)
@@ -117,79 +506,374 @@ namespace CameraReceiver
                 //int newFrameId = Interlocked.Increment(ref _frameId);
                 //_accessor.Write(0, newFrameId);
 
-                // Читаем текущий активный буфер
-                int currentBuffer;
-                try
+                if (!PublishFrame(imageData, FOURCC_BGR24, width, height, width * BYTES_PER_PIXEL))
+                    return false;
+
+                OnStatusChanged($"Отправлен кадр #{_frameId}, {width}x{height}, размер {imageData.Length} байт");
+                return true;
+            }
+            catch (Exception ex)
+            {
+                OnErrorOccurred($"Ошибка отправки кадра: {ex.Message}\n{ex.StackTrace}"); //
+                return false;
+            }
+        }
+
+        // Кадр, уже декодированный в YUV 4:2:0 (NV12 или I420, строки без
+        // выравнивания). Фильтр отдаёт такой кадр в NV12/I420 простым
+        // копированием, без круга через RGB. Отсчёты — BT.601 в полном
+        // диапазоне, как у JPEG: фильтр объявляет и пересчитывает по ним.
+        public Task<bool> SendYuvFrameAsync(byte[] yuvData, int width, int height, bool nv12)
+        {
+            if (!_isConnected || _accessor == null || !_accessor.CanWrite)
+            {
+                OnErrorOccurred("Не подключен к виртуальной камере");
+                return Task.FromResult(false);
+            }
+
+            if (width <= 0 || height <= 0 || (width & 1) != 0 || (height & 1) != 0 ||
+                yuvData.Length != width * height * 3 / 2 || yuvData.Length > SLOT_SZ)
+            {
+                OnErrorOccurred($"Неверный кадр YUV {width}x{height}, {yuvData.Length} байт");
+                return Task.FromResult(false);
+            }
+
+            if (SkipWhileIdle())
+                return Task.FromResult(true);
+
+            try
+            {
+                if (!PublishFrame(yuvData, nv12 ? FOURCC_NV12 : FOURCC_I420, width, height, width))
+                    return Task.FromResult(false);
+
+                OnStatusChanged($"Отправлен кадр #{_frameId}, {(nv12 ? "NV12" : "I420")} {width}x{height}, размер {yuvData.Length} байт");
+                return Task.FromResult(true);
+            }
+            catch (Exception ex)
+            {
+                OnErrorOccurred($"Ошибка отправки кадра: {ex.Message}\n{ex.StackTrace}");
+                return Task.FromResult(false);
+            }
+        }
+
+        private bool PublishJpeg(byte[] jpegData)
+        {
+            if (!TryReadJpegSize(jpegData, out int width, out int height))
+            {
+                OnErrorOccurred($"Не удалось прочитать размер JPEG ({jpegData.Length} байт)");
+                return false;
+            }
+            if (jpegData.Length > SLOT_SZ)
+            {
+                OnErrorOccurred($"JPEG {jpegData.Length} байт не помещается в слот");
+                return false;
+            }
+
+            try
+            {
+                if (!PublishFrame(jpegData, FOURCC_MJPG, width, height, 0))
+                    return false;
+
+                OnStatusChanged($"Отправлен кадр #{_frameId}, MJPG {width}x{height}, размер {jpegData.Length} байт");
+                return true;
+            }
+            catch (Exception ex)
+            {
+                OnErrorOccurred($"Ошибка отправки кадра: {ex.Message}\n{ex.StackTrace}");
+                return false;
+            }
+        }
+
+        // Размер кадра из маркера SOFn в заголовке JPEG, без декодирования
+        private static bool TryReadJpegSize(byte[] jpeg, out int width, out int height)
+        {
+            width = 0;
+            height = 0;
+            if (jpeg.Length < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8)
+                return false;
+
+            int i = 2;
+            while (i + 4 <= jpeg.Length)
+            {
+                if (jpeg[i] != 0xFF)
+                    return false;
+                byte marker = jpeg[i + 1];
+                if (marker == 0xFF)
                 {
-                    currentBuffer = _accessor.ReadInt32(8);
+                    i++; // байт-заполнитель перед маркером
+                    continue;
                 }
-                catch (Exception ex)
+
+                int length = (jpeg[i + 2] << 8) | jpeg[i + 3];
+                // SOF0..SOF15, кроме DHT (C4), JPG (C8) и DAC (CC)
+                if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
                 {
-                    OnErrorOccurred($"Ошибка чтения буфера: {ex.Message}");
-                    return false;
+                    if (i + 9 > jpeg.Length)
+                        return false;
+                    height = (jpeg[i + 5] << 8) | jpeg[i + 6];
+                    width = (jpeg[i + 7] << 8) | jpeg[i + 8];
+                    return width > 0 && height > 0;
                 }
+                if (marker == 0xDA || length < 2)
+                    return false; // дошли до данных (SOS), а размера не было
+                i += 2 + length;
+            }
+            return false;
+        }
 
-                // Определяем буфер для записи (противоположный активному)
-                int writeBuffer = 1 - currentBuffer;
+        // Кладёт готовый кадр в свободный слот и публикует его. false — все
+        // слоты заняты читателями (кадр пропущен) или ошибка чтения заголовка.
+        private bool PublishFrame(byte[] data, uint fourcc, int width, int height, int stride)
+        {
+            var accessor = _accessor!;
+            // Читаем текущий активный буфер
+            int currentBuffer;
+            try
+            {
+                currentBuffer = accessor.ReadInt32(OFF_CURRENT);
+            }
+            catch (Exception ex)
+            {
+                OnErrorOccurred($"Ошибка чтения буфера: {ex.Message}");
+                return false;
+            }
 
-                // Рассчитываем смещение для записи
-                long dataOffset = HEADER_SZ + writeBuffer * FRAME_SZ;
+            int writeBuffer = AcquireFreeSlot(currentBuffer, out int seq);
+            if (writeBuffer < 0 && ReclaimDeadReaders() > 0)
+                writeBuffer = AcquireFreeSlot(currentBuffer, out seq);
 
-                // Записываем данные в неактивный буфер
-                _accessor.WriteArray(dataOffset, imageData, 0, imageData.Length);
+            if (writeBuffer < 0)
+            {
+                // Все свободные слоты заняты читателями — пропускаем кадр, но не ждём
+                Interlocked.Increment(ref _droppedFrames);
+                return false;
+            }
 
-                // Барьер памяти после записи данных
-                System.Threading.Thread.MemoryBarrier();
+            // Записываем данные и их описание в свободный слот
+            long dataOffset = DATA_OFFSET + (long)writeBuffer * SLOT_SZ;
+            accessor.WriteArray(dataOffset, data, 0, data.Length);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_FOURCC), fourcc);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_WIDTH), width);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_HEIGHT), height);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_STRIDE), stride);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_SIZE), (uint)data.Length);
 
-                // Записываем размер данных
-                _accessor.Write(4, (uint)FRAME_SZ);
+            // Барьер памяти после записи данных
+            System.Threading.Thread.MemoryBarrier();
 
-                // Барьер памяти после записи размера
-                System.Threading.Thread.MemoryBarrier();
+            int newFrameId = Interlocked.Increment(ref _frameId);
+            accessor.Write(SlotOffset(writeBuffer, SLOT_FRAME_ID), newFrameId);
+
+            // Слот снова целый
+            accessor.Write(SlotOffset(writeBuffer, SLOT_SEQ), seq + 2);
+            System.Threading.Thread.MemoryBarrier();
+
+            // Переключаем активный буфер
+            accessor.Write(OFF_CURRENT, writeBuffer);
+
+            // Барьер памяти после переключения буфера
+            System.Threading.Thread.MemoryBarrier();
+
+            // В последнюю очередь публикуем номер кадра
+            accessor.Write(OFF_FRAME_ID, newFrameId);
 
-                // Переключаем активный буфер
-                _accessor.Write(8, writeBuffer);
+            // Барьер памяти после записи frameId
+            System.Threading.Thread.MemoryBarrier();
 
-                // Барьер памяти после переключения буфера
+            // Будим потоки всех пинов, ждущих новый кадр
+            SignalReaders();
+            return true;
+        }
+
+        // Взводит событие каждой занятой записи таблицы читателей. Событие
+        // открывается один раз на pid записи. Фильтр создаёт его до того, как
+        // займёт запись, так что неудача окончательна для этой записи: она
+        // запоминается вместе с pid и тем, был ли heartbeat, и попытка
+        // повторяется, только когда запись освободят или займут заново
+        // (pid сменится или heartbeat обнулится). Переход heartbeat из нуля
+        // даёт ещё одну попытку — для фильтров, создававших событие после
+        // записи pid.
+        private void SignalReaders()
+        {
+            var accessor = _accessor!;
+            for (int i = 0; i < MAX_READERS; i++)
+            {
+                int pid = accessor.ReadInt32(ReaderOffset(i, READER_PID));
+                bool live = accessor.ReadInt64(ReaderOffset(i, READER_HEARTBEAT)) != 0;
+                if (pid == 0)
+                {
+                    ForgetReaderEvent(i);
+                    continue;
+                }
+                if (_readerEvents[i] != null && _readerEventPids[i] == pid)
+                {
+                    _readerEvents[i]!.Set();
+                    continue;
+                }
+                if (_readerEventFailed[i] && _readerEventPids[i] == pid && _readerEventFailedLive[i] == live)
+                    continue;
+
+                ForgetReaderEvent(i);
+                _readerEventPids[i] = pid;
+                try
+                {
+                    if (EventWaitHandle.TryOpenExisting($"{EVENT_NAME_PREFIX}.{(uint)pid}.{i}", out var ev))
+                        _readerEvents[i] = ev;
+                }
+                catch (UnauthorizedAccessException)
+                {
+                    // Чужой пользователь: такой пин ждёт кадр по таймауту
+                }
+                if (_readerEvents[i] == null)
+                {
+                    _readerEventFailed[i] = true;
+                    _readerEventFailedLive[i] = live;
+                    continue;
+                }
+                _readerEvents[i]!.Set();
+            }
+        }
+
+        private void ForgetReaderEvent(int i)
+        {
+            _readerEvents[i]?.Dispose();
+            _readerEvents[i] = null;
+            _readerEventPids[i] = 0;
+            _readerEventFailed[i] = false;
+        }
+
+        private void CloseReaderEvents()
+        {
+            for (int i = 0; i < MAX_READERS; i++)
+                ForgetReaderEvent(i);
+        }
+
+        // Ищет слот, который не держит ни один читатель, и открывает в нём
+        // запись (seq становится нечётным). Начинает со следующего за
+        // активным — там самый старый кадр. -1 — все слоты заняты.
+        private int AcquireFreeSlot(int currentBuffer, out int seq)
+        {
+            var accessor = _accessor!;
+            seq = 0;
+            for (int k = 1; k < _slotCount; k++)
+            {
+                int candidate = (currentBuffer + k) % _slotCount;
+                if (accessor.ReadInt32(SlotOffset(candidate, SLOT_READERS)) != 0)
+                    continue;
+
+                // Seqlock: нечётный счётчик — слот пишется
+                seq = accessor.ReadInt32(SlotOffset(candidate, SLOT_SEQ));
+                if ((seq & 1) != 0)
+                    seq++; // прошлая запись оборвалась посередине
+                accessor.Write(SlotOffset(candidate, SLOT_SEQ), seq + 1);
+
+                // Полный барьер между записью seq и повторной проверкой
+                // readers (схема Деккера, парная к ReadFrame в фильтре)
                 System.Threading.Thread.MemoryBarrier();
+                if (accessor.ReadInt32(SlotOffset(candidate, SLOT_READERS)) != 0)
+                {
+                    // Читатель успел занять слот. Данные не менялись —
+                    // возвращаем прежний чётный seq, иначе читатель, уже
+                    // копирующий слот, получит ложный Torn
+                    accessor.Write(SlotOffset(candidate, SLOT_SEQ), seq);
+                    continue;
+                }
+                return candidate;
+            }
+            return -1;
+        }
 
-                // В последнюю очередь увеличиваем счетчик кадров
-                int newFrameId = Interlocked.Increment(ref _frameId);
-                _accessor.Write(0, newFrameId);
+        // Возвращает слоты, которые держали читатели из завершившихся
+        // процессов (приложение упало, не отпустив семпл), и освобождает их
+        // записи. Живых читателей не трогает, даже если они давно не брали
+        // кадров: на паузе граф держит семплы, и слоты ещё нужны. Возвращает
+        // число освобождённых записей.
+        private int ReclaimDeadReaders()
+        {
+            var accessor = _accessor!;
+            int reclaimed = 0;
+            for (int i = 0; i < MAX_READERS; i++)
+            {
+                int pid = accessor.ReadInt32(ReaderOffset(i, READER_PID));
+                if (pid == 0 || IsProcessAlive(pid))
+                    continue;
 
-                // Барьер памяти после записи frameId
+                // Процесс мёртв — в его запись больше никто не пишет
+                for (int slot = 0; slot < MAX_SLOTS; slot++)
+                {
+                    int pinsOffset = ReaderOffset(i, READER_PINS + slot * sizeof(int));
+                    int pins = accessor.ReadInt32(pinsOffset);
+                    if (pins == 0)
+                        continue;
+                    if (slot < _slotCount)
+                        AtomicAdd(SlotOffset(slot, SLOT_READERS), -pins);
+                    accessor.Write(pinsOffset, 0);
+                }
+                accessor.Write(ReaderOffset(i, READER_HEARTBEAT), 0L);
                 System.Threading.Thread.MemoryBarrier();
+                accessor.Write(ReaderOffset(i, READER_PID), 0);
+                reclaimed++;
+                OnStatusChanged($"Освобождены слоты завершившегося читателя (процесс {pid})");
+            }
+            return reclaimed;
+        }
 
-                OnStatusChanged($"Отправлен кадр #{_frameId}, размер {FRAME_SZ} байт");
-                return true;
+        private static bool IsProcessAlive(int pid)
+        {
+            try
+            {
+                using var process = Process.GetProcessById(pid);
+                return !process.HasExited;
             }
-            catch (Exception ex)
+            catch (ArgumentException)
             {
-                OnErrorOccurred($"Ошибка отправки кадра: {ex.Message}\n{ex.StackTrace}"); //
-                return false;
+                return false; // такого процесса нет
+            }
+            catch (Exception)
+            {
+                return true;  // процесс есть, но доступа к нему нет
+            }
+        }
+
+        // Атомарное сложение с полем в shared memory: счётчики читателей
+        // одновременно меняют фильтры в других процессах
+        private unsafe void AtomicAdd(long offset, int delta)
+        {
+            var view = _accessor!.SafeMemoryMappedViewHandle;
+            byte* basePtr = null;
+            view.AcquirePointer(ref basePtr);
+            try
+            {
+                Interlocked.Add(ref *(int*)(basePtr + _accessor.PointerOffset + offset), delta);
+            }
+            finally
+            {
+                view.ReleasePointer();
             }
         }
 
         private byte[] ConvertToBGR24(Bitmap bitmap)
         {
-            var rect = new Rectangle(0, 0, FRAME_W, FRAME_H);
+            int width = bitmap.Width;
+            int height = bitmap.Height;
+            var rect = new Rectangle(0, 0, width, height);
             var bmpData = bitmap.LockBits(rect, ImageLockMode.ReadOnly, PixelFormat.Format24bppRgb);
             try
             {
                 int strideBytes = Math.Abs(bmpData.Stride);
-                byte[] raw = new byte[strideBytes * FRAME_H];
+                byte[] raw = new byte[strideBytes * height];
                 Marshal.Copy(bmpData.Scan0, raw, 0, raw.Length);
 
-                byte[] bgr24 = new byte[FRAME_SZ];
+                byte[] bgr24 = new byte[width * height * BYTES_PER_PIXEL];
 
-                for (int y = 0; y < FRAME_H; y++)
+                for (int y = 0; y < height; y++)
                 {
-                    int srcY = FRAME_H - 1 - y; // bottom-up
-                    for (int x = 0; x < FRAME_W; x++)
+                    int srcY = height - 1 - y; // bottom-up
+                    for (int x = 0; x < width; x++)
                     {
-                        int srcX = FRAME_W - 1 - x; // mirror X
+                        int srcX = width - 1 - x; // mirror X
                         int srcIndex = srcY * strideBytes + srcX * 3;
-                        int dstIndex = (y * FRAME_W + x) * 3;
+                        int dstIndex = (y * width + x) * 3;
                         bgr24[dstIndex] = raw[srcIndex];
                         bgr24[dstIndex + 1] = raw[srcIndex + 1];
                         bgr24[dstIndex + 2] = raw[srcIndex + 2];
@@ -207,11 +891,56 @@ namespace CameraReceiver
         {
             _accessor?.Dispose();
             _mmf?.Dispose();
+            _largePageSection?.Dispose();
+            _largePageSection = null;
+            _largePages = false;
+            CloseReaderEvents();
             _isConnected = false;
             OnStatusChanged("Shared memory закрыта");
             return Task.CompletedTask;
         }
 
+        private static readonly IntPtr INVALID_HANDLE_VALUE = new IntPtr(-1);
+        private const uint PAGE_READWRITE = 0x04;
+        private const uint SEC_COMMIT = 0x08000000;
+        private const uint SEC_LARGE_PAGES = 0x80000000;
+        private const uint TOKEN_ADJUST_PRIVILEGES = 0x0020;
+        private const uint TOKEN_QUERY = 0x0008;
+        private const uint SE_PRIVILEGE_ENABLED = 0x00000002;
+        private const int ERROR_ALREADY_EXISTS = 183;
+        private const int ERROR_NOT_ALL_ASSIGNED = 1300;
+
+        [StructLayout(LayoutKind.Sequential, Pack = 4)]
+        private struct TOKEN_PRIVILEGES
+        {
+            public uint PrivilegeCount;
+            public long Luid;
+            public uint Attributes;
+        }
+
+        [DllImport("kernel32.dll", SetLastError = true, CharSet = CharSet.Unicode)]
+        private static extern SafeMemoryMappedFileHandle CreateFileMappingW(IntPtr hFile, IntPtr lpAttributes, uint flProtect,
+                                                                           uint dwMaximumSizeHigh, uint dwMaximumSizeLow, string lpName);
+
+        [DllImport("kernel32.dll")]
+        private static extern UIntPtr GetLargePageMinimum();
+
+        [DllImport("kernel32.dll")]
+        private static extern IntPtr GetCurrentProcess();
+
+        [DllImport("kernel32.dll", SetLastError = true)]
+        private static extern bool CloseHandle(IntPtr hObject);
+
+        [DllImport("advapi32.dll", SetLastError = true)]
+        private static extern bool OpenProcessToken(IntPtr processHandle, uint desiredAccess, out IntPtr tokenHandle);
+
+        [DllImport("advapi32.dll", SetLastError = true, CharSet = CharSet.Unicode)]
+        private static extern bool LookupPrivilegeValueW(string? systemName, string name, out long luid);
+
+        [DllImport("advapi32.dll", SetLastError = true)]
+        private static extern bool AdjustTokenPrivileges(IntPtr tokenHandle, bool disableAllPrivileges, ref TOKEN_PRIVILEGES newState,
+                                                         uint bufferLength, IntPtr previousState, IntPtr returnLength);
+
         protected void OnStatusChanged(string msg) => StatusChanged?.Invoke(this, msg);
         protected void OnErrorOccurred(string msg) => ErrorOccurred?.Invoke(this, msg);
 
@@ -0,0 +1,324 @@
+#include "pch.h"
+#include "Log.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+namespace {
+
+// Запись фиксированного размера. seq — номер позиции по схеме Вьюкова:
+// seq == pos — слот свободен для писателя, seq == pos + 1 — готов к чтению.
+struct LogRecord
+{
+    std::atomic<size_t> seq;
+    LONGLONG            qpc;     // время постановки в очередь
+    DWORD               tid;
+    int                 level;
+    int                 len;
+    char                text[236];
+};
+
+constexpr size_t kRingSize = 1024;                 // степень двойки
+constexpr size_t kRingMask = kRingSize - 1;
+constexpr DWORD  kFlushPeriodMs = 200;
+
+struct LogRing
+{
+    LogRecord           slots[kRingSize];
+    alignas(64) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(64) std::atomic<size_t> dequeuePos{ 0 };  // меняет только читатель
+    alignas(64) std::atomic<LONG>   dropped{ 0 };
+
+    LogRing()
+    {
+        for (size_t i = 0; i < kRingSize; ++i)
+            slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+};
+
+LogRing& Ring()
+{
+    static LogRing ring;
+    return ring;
+}
+
+// Привязка QPC к настенным часам — один раз на процесс
+struct LogClock
+{
+    LARGE_INTEGER freq;
+    LARGE_INTEGER qpc0;
+    ULONGLONG     fileTime0;
+
+    LogClock()
+    {
+        ::QueryPerformanceFrequency(&freq);
+        ::QueryPerformanceCounter(&qpc0);
+        FILETIME ft;
+        ::GetSystemTimeAsFileTime(&ft);
+        fileTime0 = (static_cast<ULONGLONG>(ft.dwHighDateTime) << 32) | ft.dwLowDateTime;
+    }
+};
+
+LogClock& Clock()
+{
+    static LogClock clock;
+    return clock;
+}
+
+// Состояние потока записи. События и мьютекс создаются один раз и живут до
+// выгрузки DLL, чтобы писатель никогда не обратился к закрытому хэндлу.
+CRITICAL_SECTION g_lifeLock;          // только Start/Stop, не горячий путь
+LONG   g_refs         = 0;
+HANDLE g_thread       = nullptr;
+HANDLE g_stopEvent    = nullptr;
+HANDLE g_drainMutex   = nullptr;      // читатель должен быть один
+std::atomic<HANDLE> g_wakeEvent{ nullptr };
+
+struct LogLifeLockInit
+{
+    LogLifeLockInit()  { ::InitializeCriticalSection(&g_lifeLock); }
+    ~LogLifeLockInit() { ::DeleteCriticalSection(&g_lifeLock); }
+} g_lifeLockInit;
+
+HANDLE GetLogHandle()
+{
+    static HANDLE hLog = INVALID_HANDLE_VALUE;
+    if (hLog != INVALID_HANDLE_VALUE)
+        return hLog;
+
+    const char* const fixedDir = "C:\\cwl\\VirtualCamFilter\\";
+    char path[MAX_PATH] = {};
+    strcpy_s(path, fixedDir);
+    strcat_s(path, "vCamLog.txt");
+
+    // Создаём каталог, если его нет
+    CreateDirectoryA(fixedDir, NULL);
+
+    hLog = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
+                       OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hLog != INVALID_HANDLE_VALUE)
+    {
+        // Перемещаемся в конец
+        SetFilePointer(hLog, 0, NULL, FILE_END);
+    }
+    return hLog;
+}
+
+char LevelTag(int level)
+{
+    switch (level)
+    {
+    case VCAM_LOG_LEVEL_ERROR: return 'E';
+    case VCAM_LOG_LEVEL_WARN:  return 'W';
+    case VCAM_LOG_LEVEL_INFO:  return 'I';
+    case VCAM_LOG_LEVEL_DEBUG: return 'D';
+    default:                   return 'T';
+    }
+}
+
+// Пачка строк, уходящая на диск одним WriteFile
+class LogBatch
+{
+    char  m_buf[64 * 1024];
+    DWORD m_used = 0;
+
+public:
+    void Append(const char* text, int len)
+    {
+        if (m_used + len > sizeof(m_buf))
+            Flush();
+        memcpy(m_buf + m_used, text, len);
+        m_used += len;
+    }
+
+    void Flush()
+    {
+        if (!m_used)
+            return;
+        HANDLE h = GetLogHandle();
+        if (h != INVALID_HANDLE_VALUE)
+        {
+            DWORD written;
+            WriteFile(h, m_buf, m_used, &written, NULL);
+        }
+#ifdef _DEBUG
+        m_buf[m_used < sizeof(m_buf) ? m_used : sizeof(m_buf) - 1] = 0;
+        OutputDebugStringA(m_buf);
+#endif
+        m_used = 0;
+    }
+};
+
+void AppendRecord(LogBatch& batch, const LogRecord& r)
+{
+    const LogClock& clk = Clock();
+    // Делим по частям, чтобы произведение не переполнилось через пару суток
+    const ULONGLONG ticks = static_cast<ULONGLONG>(r.qpc - clk.qpc0.QuadPart);
+    const ULONGLONG freq  = static_cast<ULONGLONG>(clk.freq.QuadPart);
+    const ULONGLONG dt100ns = ticks / freq * 10000000ULL + ticks % freq * 10000000ULL / freq;
+    const ULONGLONG t = clk.fileTime0 + dt100ns;
+
+    FILETIME ft = { static_cast<DWORD>(t), static_cast<DWORD>(t >> 32) };
+    FILETIME local;
+    SYSTEMTIME st = {};
+    FileTimeToLocalFileTime(&ft, &local);
+    FileTimeToSystemTime(&local, &st);
+
+    char prefix[48];
+    const int n = sprintf_s(prefix, "%02u:%02u:%02u.%03u %5lu %c ",
+                            st.wHour, st.wMinute, st.wSecond, st.wMilliseconds, r.tid, LevelTag(r.level));
+    batch.Append(prefix, n);
+    batch.Append(r.text, r.len);
+}
+
+// Забирает всё, что готово, и пишет на диск. Вызывается под g_drainMutex.
+void Drain(LogBatch& batch)
+{
+    LogRing& ring = Ring();
+    size_t pos = ring.dequeuePos.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        LogRecord& r = ring.slots[pos & kRingMask];
+        if (r.seq.load(std::memory_order_acquire) != pos + 1)
+            break; // пусто или писатель ещё заполняет слот
+
+        AppendRecord(batch, r);
+        r.seq.store(pos + kRingSize, std::memory_order_release);
+        ++pos;
+        ring.dequeuePos.store(pos, std::memory_order_relaxed);
+    }
+
+    const LONG dropped = ring.dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped)
+    {
+        char msg[96];
+        const int n = sprintf_s(msg, "vCam: лог переполнен, потеряно записей: %ld\n", dropped);
+        batch.Append(msg, n);
+    }
+    batch.Flush();
+}
+
+DWORD WINAPI LogThreadProc(LPVOID)
+{
+    static LogBatch batch;
+    HANDLE events[2] = { g_stopEvent, g_wakeEvent.load() };
+    for (;;)
+    {
+        const DWORD w = WaitForMultipleObjects(2, events, FALSE, kFlushPeriodMs);
+        WaitForSingleObject(g_drainMutex, INFINITE);
+        Drain(batch);
+        ReleaseMutex(g_drainMutex);
+        if (w == WAIT_OBJECT_0)
+            return 0;
+    }
+}
+
+} // namespace
+
+void LogWrite(int level, const char* fmt, ...)
+{
+    LogRing& ring = Ring();
+
+    // Занимаем слот: CAS по позиции записи
+    size_t pos = ring.enqueuePos.load(std::memory_order_relaxed);
+    LogRecord* r;
+    for (;;)
+    {
+        r = &ring.slots[pos & kRingMask];
+        const size_t seq = r->seq.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0)
+        {
+            if (ring.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // Кольцо заполнено — теряем запись, но не ждём
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = ring.enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    r->qpc   = now.QuadPart;
+    r->tid   = GetCurrentThreadId();
+    r->level = level;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int len = _vsnprintf_s(r->text, sizeof(r->text), _TRUNCATE, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+    {
+        // Обрезано — сохраняем перевод строки
+        len = static_cast<int>(sizeof(r->text)) - 1;
+        r->text[len - 1] = '\n';
+    }
+    r->len = len;
+    r->seq.store(pos + 1, std::memory_order_release);
+
+    // Будим поток записи, когда кольцо заполнено наполовину
+    if (pos - ring.dequeuePos.load(std::memory_order_relaxed) == kRingSize / 2)
+    {
+        if (HANDLE wake = g_wakeEvent.load(std::memory_order_acquire))
+            SetEvent(wake);
+    }
+}
+
+void LogStart()
+{
+    EnterCriticalSection(&g_lifeLock);
+    if (g_refs++ == 0)
+    {
+        Clock();
+        if (!g_drainMutex)
+        {
+            g_drainMutex = CreateMutexA(NULL, FALSE, NULL);
+            g_stopEvent  = CreateEventA(NULL, TRUE, FALSE, NULL);
+            g_wakeEvent.store(CreateEventA(NULL, FALSE, FALSE, NULL), std::memory_order_release);
+        }
+        ResetEvent(g_stopEvent);
+        g_thread = CreateThread(NULL, 0, LogThreadProc, NULL, 0, NULL);
+        if (g_thread)
+            SetThreadPriority(g_thread, THREAD_PRIORITY_BELOW_NORMAL);
+    }
+    LeaveCriticalSection(&g_lifeLock);
+}
+
+void LogStop()
+{
+    EnterCriticalSection(&g_lifeLock);
+    if (g_refs > 0 && --g_refs == 0)
+    {
+        if (g_thread)
+        {
+            // Поток дописывает очередь и выходит сам
+            SetEvent(g_stopEvent);
+            WaitForSingleObject(g_thread, INFINITE);
+            CloseHandle(g_thread);
+            g_thread = nullptr;
+        }
+    }
+    LeaveCriticalSection(&g_lifeLock);
+}
+
+void LogFlushNow()
+{
+    static LogBatch batch;
+    if (g_drainMutex)
+    {
+        // WAIT_ABANDONED: поток записи убит при завершении процесса
+        const DWORD w = WaitForSingleObject(g_drainMutex, 0);
+        if (w != WAIT_OBJECT_0 && w != WAIT_ABANDONED)
+            return; // очередь сейчас разбирает фоновый поток
+    }
+    Drain(batch);
+    if (g_drainMutex)
+        ReleaseMutex(g_drainMutex);
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <windows.h>
+#include <atomic>
+
+// ----------------------------------------------------------------------------
+// Асинхронный лог в C:\cwl\VirtualCamFilter\vCamLog.txt.
+// Вызывающий поток только форматирует строку в слот кольцевого буфера
+// (lock-free, несколько писателей / один читатель), на диск пишет фоновый
+// поток пачками. При переполнении записи отбрасываются, поток кадров
+// никогда не ждёт диск.
+// ----------------------------------------------------------------------------
+
+// Уровни. Всё, что подробнее VCAM_LOG_LEVEL, вырезается при компиляции
+// вместе с вычислением аргументов.
+#define VCAM_LOG_LEVEL_ERROR 1
+#define VCAM_LOG_LEVEL_WARN  2
+#define VCAM_LOG_LEVEL_INFO  3
+#define VCAM_LOG_LEVEL_DEBUG 4
+#define VCAM_LOG_LEVEL_TRACE 5
+
+#ifndef VCAM_LOG_LEVEL
+#ifdef _DEBUG
+#define VCAM_LOG_LEVEL VCAM_LOG_LEVEL_DEBUG
+#else
+#define VCAM_LOG_LEVEL VCAM_LOG_LEVEL_INFO
+#endif
+#endif
+
+// Форматирует сообщение (printf-формат) и ставит его в очередь
+void LogWrite(int level, const char* fmt, ...);
+
+// Фоновый поток записи. Start/Stop считают ссылки: поток живёт, пока жив
+// хотя бы один фильтр. Нельзя вызывать из DllMain.
+void LogStart();
+void LogStop();
+
+// Синхронно дописывает очередь из текущего потока. Для DLL_PROCESS_DETACH,
+// когда фонового потока уже нет.
+void LogFlushNow();
+
+// Ограничение частоты для одного места вызова: не чаще раза в intervalMs.
+// Подавленный вызов стоит одного чтения счётчика тиков и сравнения.
+class LogRateLimit
+{
+    std::atomic<ULONGLONG> m_next{ 0 };
+
+public:
+    bool Allow(ULONGLONG intervalMs)
+    {
+        const ULONGLONG now = ::GetTickCount64();
+        ULONGLONG next = m_next.load(std::memory_order_relaxed);
+        if (now < next)
+            return false;
+        // Из нескольких потоков проходит один
+        return m_next.compare_exchange_strong(next, now + intervalMs, std::memory_order_relaxed);
+    }
+};
+
+#define VCAM_LOG_AT_(level, ...) LogWrite(level, __VA_ARGS__)
+#define VCAM_LOG_EVERY_AT_(level, ms, ...)                  \
+    do {                                                    \
+        static LogRateLimit vcamLogRate_;                   \
+        if (vcamLogRate_.Allow(ms)) LogWrite(level, __VA_ARGS__); \
+    } while (0)
+
+#if VCAM_LOG_LEVEL >= VCAM_LOG_LEVEL_ERROR
+#define VCAM_LOG_ERROR(...)           VCAM_LOG_AT_(VCAM_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define VCAM_LOG_ERROR_EVERY(ms, ...) VCAM_LOG_EVERY_AT_(VCAM_LOG_LEVEL_ERROR, ms, __VA_ARGS__)
+#else
+#define VCAM_LOG_ERROR(...)           ((void)0)
+#define VCAM_LOG_ERROR_EVERY(ms, ...) ((void)0)
+#endif
+
+#if VCAM_LOG_LEVEL >= VCAM_LOG_LEVEL_WARN
+#define VCAM_LOG_WARN(...)            VCAM_LOG_AT_(VCAM_LOG_LEVEL_WARN, __VA_ARGS__)
+#define VCAM_LOG_WARN_EVERY(ms, ...)  VCAM_LOG_EVERY_AT_(VCAM_LOG_LEVEL_WARN, ms, __VA_ARGS__)
+#else
+#define VCAM_LOG_WARN(...)            ((void)0)
+#define VCAM_LOG_WARN_EVERY(ms, ...)  ((void)0)
+#endif
+
+#if VCAM_LOG_LEVEL >= VCAM_LOG_LEVEL_INFO
+#define VCAM_LOG_INFO(...)            VCAM_LOG_AT_(VCAM_LOG_LEVEL_INFO, __VA_ARGS__)
+#define VCAM_LOG_INFO_EVERY(ms, ...)  VCAM_LOG_EVERY_AT_(VCAM_LOG_LEVEL_INFO, ms, __VA_ARGS__)
+#else
+#define VCAM_LOG_INFO(...)            ((void)0)
+#define VCAM_LOG_INFO_EVERY(ms, ...)  ((void)0)
+#endif
+
+#if VCAM_LOG_LEVEL >= VCAM_LOG_LEVEL_DEBUG
+#define VCAM_LOG_DEBUG(...)           VCAM_LOG_AT_(VCAM_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define VCAM_LOG_DEBUG_EVERY(ms, ...) VCAM_LOG_EVERY_AT_(VCAM_LOG_LEVEL_DEBUG, ms, __VA_ARGS__)
+#else
+#define VCAM_LOG_DEBUG(...)           ((void)0)
+#define VCAM_LOG_DEBUG_EVERY(ms, ...) ((void)0)
+#endif
+
+#if VCAM_LOG_LEVEL >= VCAM_LOG_LEVEL_TRACE
+#define VCAM_LOG_TRACE(...)           VCAM_LOG_AT_(VCAM_LOG_LEVEL_TRACE, __VA_ARGS__)
+#define VCAM_LOG_TRACE_EVERY(ms, ...) VCAM_LOG_EVERY_AT_(VCAM_LOG_LEVEL_TRACE, ms, __VA_ARGS__)
+#else
+#define VCAM_LOG_TRACE(...)           ((void)0)
+#define VCAM_LOG_TRACE_EVERY(ms, ...) ((void)0)
+#endif
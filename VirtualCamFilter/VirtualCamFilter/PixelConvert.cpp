@@ -0,0 +1,600 @@
+// Скалярные и SSE2 ядра преобразования цвета. Собирается без pch.h,
+// чтобы файл оставался переносимым.
+#include "PixelConvertImpl.h"
+#include <cstring>
+#include <cstdlib>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <strings.h>
+#include <unistd.h>
+#endif
+
+#if VCAM_X86_SIMD
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// ----------------------------------------------------------------------------
+// Скалярная версия — эталон для SIMD-ядер
+// ----------------------------------------------------------------------------
+void ConvertBGR24ToNV12_Scalar(const ConvertArgs& a)
+{
+    DispatchKernel(a, [&](auto cs, auto size)
+    {
+        ForEachRowPairNV12(a, size, [](const uint8_t* s0, const uint8_t* s1,
+                                 uint8_t* y0, uint8_t* y1, uint8_t* uv, int w)
+        {
+            BGR24ToNV12RowPair_Scalar<decltype(cs)::value>(s0, s1, y0, y1, uv, 0, w);
+        });
+    });
+}
+
+void ConvertBGR24ToI420_Scalar(const ConvertArgs& a)
+{
+    DispatchKernel(a, [&](auto cs, auto size)
+    {
+        ForEachRowPairI420(a, size, [](const uint8_t* s0, const uint8_t* s1,
+                                 uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int w)
+        {
+            BGR24ToI420RowPair_Scalar<decltype(cs)::value>(s0, s1, y0, y1, u, v, 0, w);
+        });
+    });
+}
+
+void ConvertBGR24ToYUY2_Scalar(const ConvertArgs& a)
+{
+    DispatchKernel(a, [&](auto cs, auto size)
+    {
+        ForEachRow(a, size, 2, [](const uint8_t* s, uint8_t* d, int w)
+        {
+            BGR24ToYUY2Row_Scalar<decltype(cs)::value>(s, d, 0, w);
+        });
+    });
+}
+
+void CopyBGR24_Scalar(const ConvertArgs& a)
+{
+    ForEachRow(a, 3, [](const uint8_t* s, uint8_t* d, int w)
+    {
+        memcpy(d, s, static_cast<size_t>(w) * 3);
+    });
+}
+
+// ----------------------------------------------------------------------------
+// Таблицы масштабирования
+// ----------------------------------------------------------------------------
+namespace {
+
+// Одна ось: координаты те же, что у SamplePos, — результат совпадает с
+// расчётом на лету
+void BuildScaleAxis(int32_t* index, int32_t* weights, int srcSize, int dstSize)
+{
+    if (srcSize <= 0 || dstSize <= 0)
+        return;
+    const int64_t step = (static_cast<int64_t>(srcSize) << 16) / dstSize;
+    for (int i = 0; i < dstSize; ++i)
+    {
+        int i0, f;
+        SamplePos(step, i, srcSize, i0, f);
+        index[i]   = i0;
+        weights[i] = (f << 16) | (256 - f);
+    }
+}
+
+} // namespace
+
+ScaleTables::ScaleTables() = default;
+ScaleTables::~ScaleTables() = default;
+
+void ScaleTables::Build(int srcW, int srcH, int dstW, int dstH)
+{
+    if (Matches(srcW, srcH, dstW, dstH))
+        return;
+
+    // Все массивы в одном буфере, каждый с границы 64 байт
+    const auto padded = [](int n) { return n > 0 ? (static_cast<size_t>(n) + 15) & ~static_cast<size_t>(15) : 0; };
+    const size_t nx = padded(dstW), ny = padded(dstH), ncx = padded(dstW / 2), ncy = padded(dstH / 2);
+    m_arena.assign((3 * nx + 2 * ny + 2 * ncx + 2 * ncy) * sizeof(int32_t) + 64, 0);
+    int32_t* p = reinterpret_cast<int32_t*>((reinterpret_cast<uintptr_t>(m_arena.data()) + 63) & ~static_cast<uintptr_t>(63));
+    const auto take = [&p](size_t n) { int32_t* r = p; p += n; return r; };
+
+    int32_t* lumaXIndex    = take(nx);
+    int32_t* lumaXWeights  = take(nx);
+    int32_t* bgr           = take(nx);
+    int32_t* lumaYIndex    = take(ny);
+    int32_t* lumaYWeights  = take(ny);
+    int32_t* chromaXIndex  = take(ncx);
+    int32_t* chromaXWeights = take(ncx);
+    int32_t* chromaYIndex  = take(ncy);
+    int32_t* chromaYWeights = take(ncy);
+
+    BuildScaleAxis(lumaXIndex, lumaXWeights, srcW, dstW);
+    BuildScaleAxis(lumaYIndex, lumaYWeights, srcH, dstH);
+    BuildScaleAxis(chromaXIndex, chromaXWeights, srcW / 2, dstW / 2);
+    BuildScaleAxis(chromaYIndex, chromaYWeights, srcH / 2, dstH / 2);
+
+    bgrSimdCount = 0;
+    for (int x = 0; x < dstW; ++x)
+    {
+        bgr[x] = lumaXIndex[x] * 3;
+        if (bgr[x] + 8 <= srcW * 3)
+            bgrSimdCount = x + 1;
+    }
+
+    lumaX     = { lumaXIndex, lumaXWeights };
+    lumaY     = { lumaYIndex, lumaYWeights };
+    chromaX   = { chromaXIndex, chromaXWeights };
+    chromaY   = { chromaYIndex, chromaYWeights };
+    bgrOffset = bgr;
+    m_srcW = srcW;
+    m_srcH = srcH;
+    m_dstW = dstW;
+    m_dstH = dstH;
+}
+
+uint8_t* ScaleScratch(size_t bytes)
+{
+    thread_local std::vector<uint8_t> buf;
+    if (buf.size() < bytes)
+        buf.resize(bytes);
+    return buf.data();
+}
+
+const ScaleTables& ScaleTablesFor(const ConvertArgs& a)
+{
+    if (a.scale && a.scale->Matches(a.srcWidth, a.srcHeight, a.width, a.height))
+        return *a.scale;
+    thread_local ScaleTables local;
+    local.Build(a.srcWidth, a.srcHeight, a.width, a.height);
+    return local;
+}
+
+#if VCAM_X86_SIMD
+namespace {
+
+// Разбор 16 пикселей BGR24 (48 байт) на три вектора B, G, R.
+// Только SSE2: последовательные unpack'и вместо pshufb.
+inline void Deinterleave16_SSE2(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i t00 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    const __m128i t02 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+
+    const __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+    const __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+    const __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+    const __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+    const __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+    const __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+    const __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+    const __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+    const __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+    b = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+    g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+    r = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+}
+
+// Яркость для 8 пикселей в 16-битных словах. Сумма yr+yg+yb не больше
+// 256, так что 255 * 256 + 128 помещается в беззнаковую 16-битную арифметику.
+template <ColorSpace CS>
+inline __m128i Luma8_SSE2(__m128i b16, __m128i g16, __m128i r16)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    __m128i y = _mm_mullo_epi16(r16, _mm_set1_epi16(static_cast<short>(c.yr)));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(g16, _mm_set1_epi16(static_cast<short>(c.yg))));
+    y = _mm_add_epi16(y, _mm_mullo_epi16(b16, _mm_set1_epi16(static_cast<short>(c.yb))));
+    y = _mm_add_epi16(y, _mm_set1_epi16(128));
+    return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(static_cast<short>(c.yOffset)));
+}
+
+// 16 байт Y для 16 пикселей
+template <ColorSpace CS>
+inline __m128i Luma16_SSE2(__m128i b, __m128i g, __m128i r)
+{
+    const __m128i z = _mm_setzero_si128();
+    const __m128i lo = Luma8_SSE2<CS>(_mm_unpacklo_epi8(b, z), _mm_unpacklo_epi8(g, z), _mm_unpacklo_epi8(r, z));
+    const __m128i hi = Luma8_SSE2<CS>(_mm_unpackhi_epi8(b, z), _mm_unpackhi_epi8(g, z), _mm_unpackhi_epi8(r, z));
+    return _mm_packus_epi16(lo, hi);
+}
+
+// Суммы соседних байтов в 16-битных словах: v0 + v1, v2 + v3, ...
+inline __m128i PairSum8_SSE2(__m128i v)
+{
+    return _mm_add_epi16(_mm_and_si128(v, _mm_set1_epi16(0x00FF)), _mm_srli_epi16(v, 8));
+}
+
+// U/V для 8 цветов в 16-битных словах: 16 байт U0 V0 U1 V1 ... U7 V7.
+// Промежуточные значения укладываются в int16 (положительный коэффициент
+// не больше 128), сдвиг арифметический. Округление прибавляется с
+// насыщением: в полном диапазоне 128 * 255 + 128 уже не влезает в int16,
+// и насыщение даёт тот же 255, что Clamp255 в скалярной формуле.
+template <ColorSpace CS>
+inline __m128i Chroma8_SSE2(__m128i be, __m128i ge, __m128i re)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    const __m128i bias = _mm_set1_epi16(128);
+
+    __m128i u = _mm_mullo_epi16(be, _mm_set1_epi16(static_cast<short>(c.ub)));
+    u = _mm_add_epi16(u, _mm_mullo_epi16(ge, _mm_set1_epi16(static_cast<short>(c.ug))));
+    u = _mm_add_epi16(u, _mm_mullo_epi16(re, _mm_set1_epi16(static_cast<short>(c.ur))));
+    u = _mm_add_epi16(_mm_srai_epi16(_mm_adds_epi16(u, bias), 8), bias);
+
+    __m128i v = _mm_mullo_epi16(re, _mm_set1_epi16(static_cast<short>(c.vr)));
+    v = _mm_add_epi16(v, _mm_mullo_epi16(ge, _mm_set1_epi16(static_cast<short>(c.vg))));
+    v = _mm_add_epi16(v, _mm_mullo_epi16(be, _mm_set1_epi16(static_cast<short>(c.vb))));
+    v = _mm_add_epi16(_mm_srai_epi16(_mm_adds_epi16(v, bias), 8), bias);
+
+    return _mm_or_si128(u, _mm_slli_epi16(v, 8));
+}
+
+// Цветность 8 блоков 2×2 из 16 пикселей двух строк (как Box2x2)
+template <ColorSpace CS>
+inline __m128i ChromaBox2x2_SSE2(__m128i b0, __m128i g0, __m128i r0,
+                                 __m128i b1, __m128i g1, __m128i r1)
+{
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i b = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(PairSum8_SSE2(b0), PairSum8_SSE2(b1)), two), 2);
+    const __m128i g = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(PairSum8_SSE2(g0), PairSum8_SSE2(g1)), two), 2);
+    const __m128i r = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(PairSum8_SSE2(r0), PairSum8_SSE2(r1)), two), 2);
+    return Chroma8_SSE2<CS>(b, g, r);
+}
+
+// Цветность 8 пар пикселей одной строки (как Box2x1)
+template <ColorSpace CS>
+inline __m128i ChromaBox2x1_SSE2(__m128i b, __m128i g, __m128i r)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    return Chroma8_SSE2<CS>(_mm_srli_epi16(_mm_add_epi16(PairSum8_SSE2(b), one), 1),
+                        _mm_srli_epi16(_mm_add_epi16(PairSum8_SSE2(g), one), 1),
+                        _mm_srli_epi16(_mm_add_epi16(PairSum8_SSE2(r), one), 1));
+}
+
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToNV12RowPair_SSE2(const uint8_t* s0, const uint8_t* s1,
+                                    uint8_t* y0, uint8_t* y1, uint8_t* uv, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i b0, g0, r0, b1, g1, r1;
+        Deinterleave16_SSE2(s0 + x * 3, b0, g0, r0);
+        Deinterleave16_SSE2(s1 + x * 3, b1, g1, r1);
+        Store16<Stream>(y0 + x, Luma16_SSE2<CS>(b0, g0, r0));
+        Store16<Stream>(y1 + x, Luma16_SSE2<CS>(b1, g1, r1));
+        Store16<Stream>(uv + x, ChromaBox2x2_SSE2<CS>(b0, g0, r0, b1, g1, r1));
+    }
+    BGR24ToNV12RowPair_Scalar<CS>(s0, s1, y0, y1, uv, x, width);
+}
+
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToI420RowPair_SSE2(const uint8_t* s0, const uint8_t* s1,
+                                    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width)
+{
+    const __m128i z = _mm_setzero_si128();
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i b0, g0, r0, b1, g1, r1;
+        Deinterleave16_SSE2(s0 + x * 3, b0, g0, r0);
+        Deinterleave16_SSE2(s1 + x * 3, b1, g1, r1);
+        Store16<Stream>(y0 + x, Luma16_SSE2<CS>(b0, g0, r0));
+        Store16<Stream>(y1 + x, Luma16_SSE2<CS>(b1, g1, r1));
+        const __m128i uv = ChromaBox2x2_SSE2<CS>(b0, g0, r0, b1, g1, r1);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2), _mm_packus_epi16(_mm_and_si128(uv, _mm_set1_epi16(0x00FF)), z));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2), _mm_packus_epi16(_mm_srli_epi16(uv, 8), z));
+    }
+    BGR24ToI420RowPair_Scalar<CS>(s0, s1, y0, y1, u, v, x, width);
+}
+
+// Y и пары U/V чередуются распаковкой байтов: Y0 U01 Y1 V01 Y2 U23 ...
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToYUY2Row_SSE2(const uint8_t* s, uint8_t* d, int width)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m128i b, g, r;
+        Deinterleave16_SSE2(s + x * 3, b, g, r);
+        const __m128i y  = Luma16_SSE2<CS>(b, g, r);
+        const __m128i uv = ChromaBox2x1_SSE2<CS>(b, g, r);
+        Store16<Stream>(d + x * 2,      _mm_unpacklo_epi8(y, uv));
+        Store16<Stream>(d + x * 2 + 16, _mm_unpackhi_epi8(y, uv));
+    }
+    BGR24ToYUY2Row_Scalar<CS>(s, d, x, width);
+}
+
+} // namespace
+#endif
+
+void ConvertBGR24ToNV12_SSE2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 3 / 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRowPairNV12(a, size, BGR24ToNV12RowPair_SSE2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToNV12_Scalar(a);
+#endif
+}
+
+void ConvertBGR24ToI420_SSE2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 3 / 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRowPairI420(a, size, BGR24ToI420RowPair_SSE2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToI420_Scalar(a);
+#endif
+}
+
+void ConvertBGR24ToYUY2_SSE2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRow(a, size, 2, BGR24ToYUY2Row_SSE2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToYUY2_Scalar(a);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Определение возможностей процессора
+// ----------------------------------------------------------------------------
+CpuTier DetectCpuTier()
+{
+#if VCAM_X86_SIMD
+    unsigned int r1[4] = {}, r7[4] = {};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuidex(info, 1, 0);
+    for (int i = 0; i < 4; ++i) r1[i] = static_cast<unsigned int>(info[i]);
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        for (int i = 0; i < 4; ++i) r7[i] = static_cast<unsigned int>(info[i]);
+    }
+#else
+    const unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+    __cpuid_count(1, 0, r1[0], r1[1], r1[2], r1[3]);
+    if (maxLeaf >= 7)
+        __cpuid_count(7, 0, r7[0], r7[1], r7[2], r7[3]);
+#endif
+    const bool sse2 = (r1[3] & (1u << 26)) != 0;
+    if (!sse2) return CpuTier::Scalar;
+
+    const bool osxsave = (r1[2] & (1u << 27)) != 0;
+    const bool avx     = (r1[2] & (1u << 28)) != 0;
+    if (!osxsave || !avx) return CpuTier::SSE2;
+
+    // ОС должна сохранять расширенные регистры при переключении контекста
+#if defined(_MSC_VER)
+    const unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    const unsigned long long xcr0 = (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+    const bool avx2 = (r7[1] & (1u << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    if (!avx2) return CpuTier::SSE2;
+
+    // AVX-512F + AVX-512BW, ОС сохраняет opmask и ZMM (биты 5..7 XCR0)
+    const bool avx512 = (r7[1] & (1u << 16)) != 0 && (r7[1] & (1u << 30)) != 0 && (xcr0 & 0xE6) == 0xE6;
+    return avx512 ? CpuTier::AVX512 : CpuTier::AVX2;
+#else
+    return CpuTier::Scalar;
+#endif
+}
+
+const char* CpuTierName(CpuTier tier)
+{
+    switch (tier)
+    {
+    case CpuTier::Scalar: return "scalar";
+    case CpuTier::SSE2:   return "sse2";
+    case CpuTier::AVX2:   return "avx2";
+    case CpuTier::AVX512: return "avx512";
+    default:              return "unknown";
+    }
+}
+
+const char* ColorSpaceName(ColorSpace cs)
+{
+    switch (cs)
+    {
+    case ColorSpace::BT601Limited: return "BT.601 16-235";
+    case ColorSpace::BT709Limited: return "BT.709 16-235";
+    case ColorSpace::BT601Full:    return "BT.601 0-255";
+    case ColorSpace::BT709Full:    return "BT.709 0-255";
+    default:                       return "unknown";
+    }
+}
+
+// Объём кэша последнего уровня (обычно общий L3, иначе L2); 0 — узнать не удалось
+static size_t DetectLastLevelCacheSize()
+{
+#if defined(_WIN32)
+    DWORD bytes = 0;
+    GetLogicalProcessorInformation(nullptr, &bytes);
+    if (bytes == 0)
+        return 0;
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(bytes / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (!GetLogicalProcessorInformation(info.data(), &bytes))
+        return 0;
+    BYTE level = 0;
+    size_t size = 0;
+    for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& i : info)
+    {
+        if (i.Relationship == RelationCache && i.Cache.Level >= level &&
+            (i.Cache.Type == CacheUnified || i.Cache.Type == CacheData))
+        {
+            level = i.Cache.Level;
+            size = i.Cache.Size;
+        }
+    }
+    return size;
+#else
+    long size = 0;
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+    size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+    if (size <= 0)
+        size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    return size > 0 ? static_cast<size_t>(size) : 0;
+#endif
+}
+
+size_t StreamingStoreThreshold()
+{
+    static const size_t threshold = []
+    {
+        const size_t llc = DetectLastLevelCacheSize();
+        return llc ? llc : SIZE_MAX;   // не узнали — всегда через кэш
+    }();
+    return threshold;
+}
+
+static bool ParseCpuTier(const char* text, CpuTier& tier)
+{
+    for (int i = 0; i < static_cast<int>(CpuTier::Count); ++i)
+    {
+        const CpuTier t = static_cast<CpuTier>(i);
+#if defined(_MSC_VER)
+        if (_stricmp(text, CpuTierName(t)) == 0)
+#else
+        if (strcasecmp(text, CpuTierName(t)) == 0)
+#endif
+        {
+            tier = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Принудительный уровень из окружения или реестра (для замеров)
+static bool ReadCpuTierOverride(CpuTier& tier)
+{
+    char value[32] = {};
+#if defined(_WIN32)
+    DWORD n = GetEnvironmentVariableA("VCAM_CPU_TIER", value, sizeof(value));
+    if (n > 0 && n < sizeof(value) && ParseCpuTier(value, tier))
+        return true;
+
+    DWORD cb = sizeof(value);
+    if (RegGetValueA(HKEY_CURRENT_USER, "Software\\VirtualCamFilter", "CpuTier",
+                     RRF_RT_REG_SZ, nullptr, value, &cb) == ERROR_SUCCESS)
+        return ParseCpuTier(value, tier);
+    return false;
+#else
+    const char* env = getenv("VCAM_CPU_TIER");
+    if (!env) return false;
+    strncpy(value, env, sizeof(value) - 1);
+    return ParseCpuTier(value, tier);
+#endif
+}
+
+CpuTier ActiveCpuTier()
+{
+    static const CpuTier active = []
+    {
+        const CpuTier detected = DetectCpuTier();
+        CpuTier forced;
+        // Повысить уровень сверх возможностей процессора нельзя
+        if (ReadCpuTierOverride(forced) && forced < detected)
+            return forced;
+        return detected;
+    }();
+    return active;
+}
+
+// ----------------------------------------------------------------------------
+// Таблица всех реализаций. Для пары форматов берётся запись с наибольшим
+// уровнем, не превышающим активный.
+// ----------------------------------------------------------------------------
+struct KernelEntry
+{
+    PixelFormat src;
+    PixelFormat dst;
+    CpuTier     tier;
+    ConvertFn   fn;
+};
+
+static const KernelEntry g_kernels[] =
+{
+    { PixelFormat::BGR24, PixelFormat::NV12,  CpuTier::Scalar, ConvertBGR24ToNV12_Scalar },
+    { PixelFormat::BGR24, PixelFormat::NV12,  CpuTier::SSE2,   ConvertBGR24ToNV12_SSE2   },
+    { PixelFormat::BGR24, PixelFormat::NV12,  CpuTier::AVX2,   ConvertBGR24ToNV12_AVX2   },
+    { PixelFormat::BGR24, PixelFormat::I420,  CpuTier::Scalar, ConvertBGR24ToI420_Scalar },
+    { PixelFormat::BGR24, PixelFormat::I420,  CpuTier::SSE2,   ConvertBGR24ToI420_SSE2   },
+    { PixelFormat::BGR24, PixelFormat::I420,  CpuTier::AVX2,   ConvertBGR24ToI420_AVX2   },
+    { PixelFormat::BGR24, PixelFormat::YUY2,  CpuTier::Scalar, ConvertBGR24ToYUY2_Scalar },
+    { PixelFormat::BGR24, PixelFormat::YUY2,  CpuTier::SSE2,   ConvertBGR24ToYUY2_SSE2   },
+    { PixelFormat::BGR24, PixelFormat::YUY2,  CpuTier::AVX2,   ConvertBGR24ToYUY2_AVX2   },
+    { PixelFormat::BGR24, PixelFormat::BGR24, CpuTier::Scalar, CopyBGR24_Scalar          },
+    { PixelFormat::NV12,  PixelFormat::NV12,  CpuTier::Scalar, ConvertNV12ToNV12_Scalar  },
+    { PixelFormat::NV12,  PixelFormat::I420,  CpuTier::Scalar, ConvertNV12ToI420_Scalar  },
+    { PixelFormat::NV12,  PixelFormat::YUY2,  CpuTier::Scalar, ConvertNV12ToYUY2_Scalar  },
+    { PixelFormat::NV12,  PixelFormat::BGR24, CpuTier::Scalar, ConvertNV12ToBGR24_Scalar },
+    { PixelFormat::I420,  PixelFormat::NV12,  CpuTier::Scalar, ConvertI420ToNV12_Scalar  },
+    { PixelFormat::I420,  PixelFormat::I420,  CpuTier::Scalar, ConvertI420ToI420_Scalar  },
+    { PixelFormat::I420,  PixelFormat::YUY2,  CpuTier::Scalar, ConvertI420ToYUY2_Scalar  },
+    { PixelFormat::I420,  PixelFormat::BGR24, CpuTier::Scalar, ConvertI420ToBGR24_Scalar },
+};
+
+ConvertFn GetConverter(PixelFormat src, PixelFormat dst)
+{
+    constexpr int kFormats = static_cast<int>(PixelFormat::Count);
+    struct Bindings { ConvertFn fn[kFormats][kFormats]; };
+
+    // Привязка выполняется один раз на процесс
+    static const Bindings bound = []
+    {
+        Bindings b = {};
+        CpuTier best[kFormats][kFormats] = {};
+        const CpuTier active = ActiveCpuTier();
+        for (const KernelEntry& e : g_kernels)
+        {
+            const int s = static_cast<int>(e.src), d = static_cast<int>(e.dst);
+            if (e.tier > active) continue;
+            if (!b.fn[s][d] || e.tier > best[s][d])
+            {
+                b.fn[s][d] = e.fn;
+                best[s][d] = e.tier;
+            }
+        }
+        return b;
+    }();
+
+    const int s = static_cast<int>(src), d = static_cast<int>(dst);
+    if (s < 0 || s >= kFormats || d < 0 || d >= kFormats)
+        return nullptr;
+    return bound.fn[s][d];
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ----------------------------------------------------------------------------
+// Ядра преобразования цвета BGR24 -> YUV и кадров YUV 4:2:0 от писателя.
+// Файл не зависит от Windows/DirectShow, чтобы ядра можно было собрать
+// отдельно (в т.ч. на Linux) и сравнить со старым скалярным циклом.
+// ----------------------------------------------------------------------------
+
+// Форматы пикселей. MEDIASUBTYPE_RGB24 в памяти — это тот же BGR24.
+enum class PixelFormat { BGR24, NV12, I420, YUY2, Count };
+
+// Уровни набора инструкций, по возрастанию
+enum class CpuTier { Scalar, SSE2, AVX2, AVX512, Count };
+
+// Матрица и диапазон YUV-стороны преобразования
+enum class ColorSpace { BT601Limited, BT709Limited, BT601Full, BT709Full, Count };
+
+// Запись выходного кадра: через кэш или в обход него (movnt). Сразу после
+// FillBuffer кадр читает получатель, и до 1080p включительно кадр из кэша
+// он читает в 2-2.5 раза быстрее, а само преобразование movnt не ускоряет
+// (tests/StoreModeBench.cpp). В обход кэша стоит писать только кадр, который
+// в кэше всё равно не поместится.
+enum class StoreMode { Auto, Cached, Streaming };
+
+class ScaleTables;
+
+// Параметры преобразования одного кадра. Если размер источника отличается
+// от выходного, кадр масштабируется билинейно в том же проходе: строки
+// источника читаются один раз, промежуточный кадр не создаётся.
+struct ConvertArgs
+{
+    const uint8_t* src;       // кадр источника, строки по srcStride байт
+    int            srcStride; // шаг строки (для NV12/I420 — плоскости Y) в байтах
+    int            srcWidth;  // размер источника
+    int            srcHeight;
+    uint8_t*       dst;       // выходной кадр, плоскости идут подряд
+    int            width;     // размер выходного кадра (чётный)
+    int            height;
+    bool           flipV;     // источник bottom-up — переворачиваем по вертикали
+    // Полоса выходных строк [rowBegin, rowEnd) для параллельной конвертации.
+    // rowEnd == 0 — до конца кадра. rowBegin должен быть чётным (пара строк
+    // 4:2:0 не делится между полосами).
+    int            rowBegin;
+    int            rowEnd;
+    ColorSpace     colorSpace; // по умолчанию BT.601, 16..235
+    // Матрица и диапазон источника в YUV (NV12/I420). Если они не совпадают
+    // с colorSpace YUV-выхода, ядро пересчитывает отсчёты, а не копирует их;
+    // для выхода в BGR24 по ним декодируется источник.
+    ColorSpace     srcColorSpace;
+    // Готовые таблицы масштабирования для этих размеров. nullptr (или
+    // таблицы для других размеров) — ядро возьмёт свои, кэшированные в потоке.
+    const ScaleTables* scale;
+    // Auto — в обход кэша, если кадр больше StreamingStoreThreshold().
+    // Только SIMD-ядра, и только при dst и ширине, кратных 32.
+    StoreMode      store;
+};
+
+// ----------------------------------------------------------------------------
+// Таблицы билинейного масштабирования для пары размеров источник -> выход:
+// для каждой выходной позиции индекс первого соседа в источнике и пара
+// весов. Пин строит их при выборе медиатипа и при смене размера кадров
+// писателя, ядра всех полос только читают. Массивы выровнены на 64 байта
+// и дополнены до 16 элементов, векторные ветви читают их выровненно.
+// ----------------------------------------------------------------------------
+struct ScaleAxis
+{
+    const int32_t* index;   // первый сосед в источнике
+    const int32_t* weights; // (f << 16) | (256 - f), f — вес второго соседа, 0..255
+};
+
+class ScaleTables
+{
+public:
+    // Не inline: std::vector инстанцируется только в PixelConvert.cpp
+    ScaleTables();
+    ~ScaleTables();
+    ScaleTables(const ScaleTables&) = delete;
+    ScaleTables& operator=(const ScaleTables&) = delete;
+
+    // Пересчитывает таблицы, если размеры поменялись
+    void Build(int srcW, int srcH, int dstW, int dstH);
+    bool Matches(int srcW, int srcH, int dstW, int dstH) const
+    {
+        return m_srcW == srcW && m_srcH == srcH && m_dstW == dstW && m_dstH == dstH;
+    }
+
+    ScaleAxis      lumaX   = {};   // BGR24 и плоскость Y
+    ScaleAxis      lumaY   = {};
+    ScaleAxis      chromaX = {};   // плоскости цветности 4:2:0, вдвое меньше
+    ScaleAxis      chromaY = {};
+    const int32_t* bgrOffset = nullptr; // lumaX.index * 3 — смещения в байтах для gather
+    int            bgrSimdCount = 0;    // сколько первых пикселей можно читать по 8 байт
+
+private:
+    std::vector<uint8_t> m_arena;
+    int m_srcW = 0, m_srcH = 0, m_dstW = 0, m_dstH = 0;
+};
+
+using ConvertFn = void (*)(const ConvertArgs&);
+
+// Матрица выбирается один раз на вызов ядра: внутри ядро развёрнуто под
+// коэффициенты этой матрицы, на пиксель выбор ничего не стоит.
+
+// BGR24 -> NV12 (плоскость Y, затем чередующиеся U/V)
+void ConvertBGR24ToNV12_Scalar(const ConvertArgs& a);
+void ConvertBGR24ToNV12_SSE2(const ConvertArgs& a);   // 16 пикселей за итерацию
+void ConvertBGR24ToNV12_AVX2(const ConvertArgs& a);   // 32 пикселя за итерацию
+
+// BGR24 -> I420 (плоскости Y, U, V)
+void ConvertBGR24ToI420_Scalar(const ConvertArgs& a);
+void ConvertBGR24ToI420_SSE2(const ConvertArgs& a);
+void ConvertBGR24ToI420_AVX2(const ConvertArgs& a);
+
+// BGR24 -> YUY2 (Y0 U Y1 V)
+void ConvertBGR24ToYUY2_Scalar(const ConvertArgs& a);
+void ConvertBGR24ToYUY2_SSE2(const ConvertArgs& a);
+void ConvertBGR24ToYUY2_AVX2(const ConvertArgs& a);
+
+// BGR24 -> BGR24 (построчное копирование, с переворотом при flipV)
+void CopyBGR24_Scalar(const ConvertArgs& a);
+
+// NV12/I420 -> всё остальное. В одном размере — копирование плоскостей и
+// перестановка байтов цветности, иначе ещё и билинейное масштабирование.
+// Если srcColorSpace != colorSpace, YUV-выходы после копирования проходят
+// ApplyYuvMatrix: пара U/V и делящие её отсчёты Y пересчитываются из
+// матрицы и диапазона источника в матрицу и диапазон выхода (фиксированная
+// точка 16.16, без захода в RGB). BGR24 декодируется сразу по srcColorSpace.
+// В YUY2 строка цветности 4:2:0 повторяется для обеих строк своей пары.
+void ConvertNV12ToNV12_Scalar(const ConvertArgs& a);
+void ConvertNV12ToI420_Scalar(const ConvertArgs& a);
+void ConvertNV12ToYUY2_Scalar(const ConvertArgs& a);
+void ConvertNV12ToBGR24_Scalar(const ConvertArgs& a);
+void ConvertI420ToNV12_Scalar(const ConvertArgs& a);
+void ConvertI420ToI420_Scalar(const ConvertArgs& a);
+void ConvertI420ToYUY2_Scalar(const ConvertArgs& a);
+void ConvertI420ToBGR24_Scalar(const ConvertArgs& a);
+
+// ----------------------------------------------------------------------------
+// Реестр ядер. Процессор определяется один раз (cpuid), после чего каждой паре
+// (источник, приёмник) сопоставляется самая быстрая доступная реализация.
+// Уровень можно принудительно понизить для замеров: переменная окружения
+// VCAM_CPU_TIER или строковое значение CpuTier в HKCU\Software\VirtualCamFilter
+// ("scalar", "sse2", "avx2", "avx512").
+// ----------------------------------------------------------------------------
+CpuTier     DetectCpuTier();   // что умеет процессор и ОС
+CpuTier     ActiveCpuTier();   // с учётом переопределения
+const char* CpuTierName(CpuTier tier);
+const char* ColorSpaceName(ColorSpace cs);
+
+// Порог размера кадра для StoreMode::Auto — объём кэша последнего уровня:
+// кадр больше него до получателя в кэше не доживёт, меньший — доживёт, даже
+// если не влез в L2 ядра. SIZE_MAX, если объём узнать не удалось.
+size_t      StreamingStoreThreshold();
+
+// Возвращает ядро для пары форматов или nullptr, если пара не поддерживается
+ConvertFn GetConverter(PixelFormat src, PixelFormat dst);
@@ -0,0 +1,230 @@
+// AVX2-ядра преобразования цвета. Файл собирается с /arch:AVX2 (-mavx2)
+// и вызывается только после проверки CPU в PixelConvert.cpp.
+#include "PixelConvertImpl.h"
+
+#if VCAM_X86_SIMD
+#include <immintrin.h>
+
+namespace {
+
+// Разбор 16 пикселей BGR24 на B, G, R через pshufb (есть на любом AVX2 CPU)
+inline void Deinterleave16_SSSE3(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r)
+{
+    const __m128i t0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i t1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    const __m128i t2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(t0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(t1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(t2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(t0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(t1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(t2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(t0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(t1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(t2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+// 32 пикселя: младшая 128-битная половина — пиксели 0..15, старшая — 16..31
+inline void Deinterleave32_AVX2(const uint8_t* p, __m256i& b, __m256i& g, __m256i& r)
+{
+    __m128i b0, g0, r0, b1, g1, r1;
+    Deinterleave16_SSSE3(p, b0, g0, r0);
+    Deinterleave16_SSSE3(p + 48, b1, g1, r1);
+    b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+    g = _mm256_inserti128_si256(_mm256_castsi128_si256(g0), g1, 1);
+    r = _mm256_inserti128_si256(_mm256_castsi128_si256(r0), r1, 1);
+}
+
+template <ColorSpace CS>
+inline __m256i Luma16_AVX2(__m256i b16, __m256i g16, __m256i r16)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    __m256i y = _mm256_mullo_epi16(r16, _mm256_set1_epi16(static_cast<short>(c.yr)));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(g16, _mm256_set1_epi16(static_cast<short>(c.yg))));
+    y = _mm256_add_epi16(y, _mm256_mullo_epi16(b16, _mm256_set1_epi16(static_cast<short>(c.yb))));
+    y = _mm256_add_epi16(y, _mm256_set1_epi16(128));
+    return _mm256_add_epi16(_mm256_srli_epi16(y, 8), _mm256_set1_epi16(static_cast<short>(c.yOffset)));
+}
+
+// unpack/pack работают внутри 128-битных половин, поэтому порядок
+// пикселей после packus восстанавливается сам собой.
+template <ColorSpace CS>
+inline __m256i Luma32_AVX2(__m256i b, __m256i g, __m256i r)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i lo = Luma16_AVX2<CS>(_mm256_unpacklo_epi8(b, z), _mm256_unpacklo_epi8(g, z), _mm256_unpacklo_epi8(r, z));
+    const __m256i hi = Luma16_AVX2<CS>(_mm256_unpackhi_epi8(b, z), _mm256_unpackhi_epi8(g, z), _mm256_unpackhi_epi8(r, z));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// Суммы соседних байтов в 16-битных словах
+inline __m256i PairSum16_AVX2(__m256i v)
+{
+    return _mm256_add_epi16(_mm256_and_si256(v, _mm256_set1_epi16(0x00FF)), _mm256_srli_epi16(v, 8));
+}
+
+// 32 байта U/V для 16 цветов в 16-битных словах (округление с насыщением,
+// как в Chroma8_SSE2)
+template <ColorSpace CS>
+inline __m256i Chroma16_AVX2(__m256i be, __m256i ge, __m256i re)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    const __m256i bias = _mm256_set1_epi16(128);
+
+    __m256i u = _mm256_mullo_epi16(be, _mm256_set1_epi16(static_cast<short>(c.ub)));
+    u = _mm256_add_epi16(u, _mm256_mullo_epi16(ge, _mm256_set1_epi16(static_cast<short>(c.ug))));
+    u = _mm256_add_epi16(u, _mm256_mullo_epi16(re, _mm256_set1_epi16(static_cast<short>(c.ur))));
+    u = _mm256_add_epi16(_mm256_srai_epi16(_mm256_adds_epi16(u, bias), 8), bias);
+
+    __m256i v = _mm256_mullo_epi16(re, _mm256_set1_epi16(static_cast<short>(c.vr)));
+    v = _mm256_add_epi16(v, _mm256_mullo_epi16(ge, _mm256_set1_epi16(static_cast<short>(c.vg))));
+    v = _mm256_add_epi16(v, _mm256_mullo_epi16(be, _mm256_set1_epi16(static_cast<short>(c.vb))));
+    v = _mm256_add_epi16(_mm256_srai_epi16(_mm256_adds_epi16(v, bias), 8), bias);
+
+    return _mm256_or_si256(u, _mm256_slli_epi16(v, 8));
+}
+
+// Цветность 16 блоков 2×2 из 32 пикселей двух строк (как Box2x2)
+template <ColorSpace CS>
+inline __m256i ChromaBox2x2_AVX2(__m256i b0, __m256i g0, __m256i r0,
+                                 __m256i b1, __m256i g1, __m256i r1)
+{
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m256i b = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(PairSum16_AVX2(b0), PairSum16_AVX2(b1)), two), 2);
+    const __m256i g = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(PairSum16_AVX2(g0), PairSum16_AVX2(g1)), two), 2);
+    const __m256i r = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(PairSum16_AVX2(r0), PairSum16_AVX2(r1)), two), 2);
+    return Chroma16_AVX2<CS>(b, g, r);
+}
+
+// Цветность 16 пар пикселей одной строки (как Box2x1)
+template <ColorSpace CS>
+inline __m256i ChromaBox2x1_AVX2(__m256i b, __m256i g, __m256i r)
+{
+    const __m256i one = _mm256_set1_epi16(1);
+    return Chroma16_AVX2<CS>(_mm256_srli_epi16(_mm256_add_epi16(PairSum16_AVX2(b), one), 1),
+                         _mm256_srli_epi16(_mm256_add_epi16(PairSum16_AVX2(g), one), 1),
+                         _mm256_srli_epi16(_mm256_add_epi16(PairSum16_AVX2(r), one), 1));
+}
+
+// Запись 32 байт: в обход кэша (адрес тогда выровнен) или обычная
+template <bool Stream>
+inline void Store32(uint8_t* p, __m256i v)
+{
+    if (Stream)
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(p), v);
+    else
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToNV12RowPair_AVX2(const uint8_t* s0, const uint8_t* s1,
+                                    uint8_t* y0, uint8_t* y1, uint8_t* uv, int width)
+{
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i b0, g0, r0, b1, g1, r1;
+        Deinterleave32_AVX2(s0 + x * 3, b0, g0, r0);
+        Deinterleave32_AVX2(s1 + x * 3, b1, g1, r1);
+        Store32<Stream>(y0 + x, Luma32_AVX2<CS>(b0, g0, r0));
+        Store32<Stream>(y1 + x, Luma32_AVX2<CS>(b1, g1, r1));
+        Store32<Stream>(uv + x, ChromaBox2x2_AVX2<CS>(b0, g0, r0, b1, g1, r1));
+    }
+    BGR24ToNV12RowPair_Scalar<CS>(s0, s1, y0, y1, uv, x, width);
+}
+
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToI420RowPair_AVX2(const uint8_t* s0, const uint8_t* s1,
+                                    uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v, int width)
+{
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i b0, g0, r0, b1, g1, r1;
+        Deinterleave32_AVX2(s0 + x * 3, b0, g0, r0);
+        Deinterleave32_AVX2(s1 + x * 3, b1, g1, r1);
+        Store32<Stream>(y0 + x, Luma32_AVX2<CS>(b0, g0, r0));
+        Store32<Stream>(y1 + x, Luma32_AVX2<CS>(b1, g1, r1));
+
+        // packus по половинам даёт [U0 V0 | U1 V1] по 8 байт — переставляем
+        // четвертинки так, чтобы внизу оказались все U, вверху все V
+        const __m256i uv = ChromaBox2x2_AVX2<CS>(b0, g0, r0, b1, g1, r1);
+        const __m256i packed = _mm256_packus_epi16(_mm256_and_si256(uv, _mm256_set1_epi16(0x00FF)),
+                                                   _mm256_srli_epi16(uv, 8));
+        const __m256i planar = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        Store16<Stream>(u + x / 2, _mm256_castsi256_si128(planar));
+        Store16<Stream>(v + x / 2, _mm256_extracti128_si256(planar, 1));
+    }
+    BGR24ToI420RowPair_Scalar<CS>(s0, s1, y0, y1, u, v, x, width);
+}
+
+template <ColorSpace CS, bool Stream>
+inline void BGR24ToYUY2Row_AVX2(const uint8_t* s, uint8_t* d, int width)
+{
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        __m256i b, g, r;
+        Deinterleave32_AVX2(s + x * 3, b, g, r);
+        const __m256i y  = Luma32_AVX2<CS>(b, g, r);
+        const __m256i uv = ChromaBox2x1_AVX2<CS>(b, g, r);
+        // lo: пиксели 0..7 и 16..23, hi: 8..15 и 24..31
+        const __m256i lo = _mm256_unpacklo_epi8(y, uv);
+        const __m256i hi = _mm256_unpackhi_epi8(y, uv);
+        Store32<Stream>(d + x * 2,      _mm256_permute2x128_si256(lo, hi, 0x20));
+        Store32<Stream>(d + x * 2 + 32, _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    BGR24ToYUY2Row_Scalar<CS>(s, d, x, width);
+}
+
+} // namespace
+#endif
+
+void ConvertBGR24ToNV12_AVX2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 3 / 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRowPairNV12(a, size, BGR24ToNV12RowPair_AVX2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToNV12_Scalar(a);
+#endif
+}
+
+void ConvertBGR24ToI420_AVX2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 3 / 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRowPairI420(a, size, BGR24ToI420RowPair_AVX2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToI420_Scalar(a);
+#endif
+}
+
+void ConvertBGR24ToYUY2_AVX2(const ConvertArgs& a)
+{
+#if VCAM_X86_SIMD
+    DispatchStoreMode(a, static_cast<size_t>(a.width) * a.height * 2, [&](auto stream)
+    {
+        DispatchKernel(a, [&](auto cs, auto size)
+        {
+            ForEachRow(a, size, 2, BGR24ToYUY2Row_AVX2<decltype(cs)::value, decltype(stream)::value>);
+        });
+    });
+#else
+    ConvertBGR24ToYUY2_Scalar(a);
+#endif
+}
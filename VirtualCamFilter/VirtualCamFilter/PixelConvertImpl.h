@@ -0,0 +1,544 @@
+#pragma once
+#include "PixelConvert.h"
+
+// ----------------------------------------------------------------------------
+// Внутренние помощники ядер преобразования. Подключается только из
+// PixelConvert*.cpp. Всё объявлено в анонимном пространстве имён: файлы
+// собираются с разными наборами инструкций (/arch:AVX2 и без него), и общая
+// inline-функция не должна «склеиться» линкером в AVX2-вариант.
+// ----------------------------------------------------------------------------
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VCAM_X86_SIMD 1
+#if defined(__AVX2__)
+#include <immintrin.h>
+#else
+#include <emmintrin.h>
+#endif
+#else
+#define VCAM_X86_SIMD 0
+#endif
+
+// Помощники с контейнерами std и thread_local — не inline, определены в
+// PixelConvert.cpp. Их инстанцирования (std::vector и т. п.) тоже inline, и
+// анонимное пространство имён их не прячет: будь они здесь, AVX2-файл выдал
+// бы свои COMDAT-копии, и линкер мог бы взять их для SSE2-путей.
+
+// Временный буфер потока для промасштабированных строк
+uint8_t* ScaleScratch(size_t bytes);
+
+// Таблицы для размеров a: переданные пином, если подходят, иначе свои,
+// кэшированные в потоке до смены размеров
+const ScaleTables& ScaleTablesFor(const ConvertArgs& a);
+
+namespace {
+
+inline uint8_t Clamp255(int v) { return static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v)); }
+
+// Коэффициенты RGB <-> YUV в фиксированной точке с 8 битами дробной части.
+// Прямые коэффициенты укладываются в int16 вместе с суммой по строке,
+// поэтому их берут и SIMD-ядра.
+struct YuvCoeffs
+{
+    int yr, yg, yb, yOffset;    // Y = (yr*R + yg*G + yb*B + 128) >> 8 + yOffset
+    int ur, ug, ub;             // U = (ur*R + ug*G + ub*B + 128) >> 8 + 128
+    int vr, vg, vb;             // V — так же
+    int yScale, rv, gu, gv, bu; // обратное: c = yScale*(Y - yOffset), R = c + rv*V' ...
+};
+
+constexpr int ToFixed8(double v) { return static_cast<int>(v < 0 ? v * 256 - 0.5 : v * 256 + 0.5); }
+
+// Средний коэффициент строки добирается из суммы, а не округляется сам:
+// так белый даёт ровно 235 (255), а серый — нулевую цветность.
+constexpr YuvCoeffs MakeYuvCoeffs(double kr, double kb, bool fullRange)
+{
+    const double kg = 1.0 - kr - kb;
+    const double ys = fullRange ? 1.0 : 219.0 / 255.0;
+    const double cs = fullRange ? 1.0 : 224.0 / 255.0;
+    const int yr = ToFixed8(kr * ys);
+    const int yb = ToFixed8(kb * ys);
+    const int ub = ToFixed8(0.5 * cs);
+    const int ur = -ToFixed8(kr / (2 * (1 - kb)) * cs);
+    const int vr = ToFixed8(0.5 * cs);
+    const int vb = -ToFixed8(kb / (2 * (1 - kr)) * cs);
+    return { yr, ToFixed8(ys) - yr - yb, yb, fullRange ? 0 : 16,
+             ur, -(ub + ur), ub,
+             vr, -(vr + vb), vb,
+             ToFixed8(1 / ys), ToFixed8(2 * (1 - kr) / cs), ToFixed8(2 * (1 - kb) * kb / kg / cs),
+             ToFixed8(2 * (1 - kr) * kr / kg / cs), ToFixed8(2 * (1 - kb) / cs) };
+}
+
+// В порядке ColorSpace
+constexpr YuvCoeffs kYuvCoeffs[] =
+{
+    MakeYuvCoeffs(0.299,  0.114,  false),
+    MakeYuvCoeffs(0.2126, 0.0722, false),
+    MakeYuvCoeffs(0.299,  0.114,  true),
+    MakeYuvCoeffs(0.2126, 0.0722, true),
+};
+static_assert(sizeof(kYuvCoeffs) / sizeof(kYuvCoeffs[0]) == static_cast<size_t>(ColorSpace::Count), "таблица по ColorSpace");
+
+// BT.601 16..235 обязан совпасть с прежними константами бит в бит
+static_assert(kYuvCoeffs[0].yr == 66 && kYuvCoeffs[0].yg == 129 && kYuvCoeffs[0].yb == 25, "BT.601 Y");
+static_assert(kYuvCoeffs[0].ur == -38 && kYuvCoeffs[0].ug == -74 && kYuvCoeffs[0].ub == 112, "BT.601 U");
+static_assert(kYuvCoeffs[0].vr == 112 && kYuvCoeffs[0].vg == -94 && kYuvCoeffs[0].vb == -18, "BT.601 V");
+static_assert(kYuvCoeffs[0].yScale == 298 && kYuvCoeffs[0].rv == 409 && kYuvCoeffs[0].gu == 100 &&
+              kYuvCoeffs[0].gv == 208 && kYuvCoeffs[0].bu == 516, "BT.601 обратное");
+
+template <ColorSpace CS>
+constexpr YuvCoeffs Coeffs() { return kYuvCoeffs[static_cast<int>(CS)]; }
+
+template <ColorSpace CS>
+using ColorSpaceTag = std::integral_constant<ColorSpace, CS>;
+
+// Вызывает fn(ColorSpaceTag<cs>) — одна развилка на вызов ядра
+template <class Fn>
+inline void DispatchColorSpace(ColorSpace cs, Fn&& fn)
+{
+    switch (cs)
+    {
+    case ColorSpace::BT709Limited: fn(ColorSpaceTag<ColorSpace::BT709Limited>()); break;
+    case ColorSpace::BT601Full:    fn(ColorSpaceTag<ColorSpace::BT601Full>());    break;
+    case ColorSpace::BT709Full:    fn(ColorSpaceTag<ColorSpace::BT709Full>());    break;
+    default:                       fn(ColorSpaceTag<ColorSpace::BT601Limited>()); break;
+    }
+}
+
+// Размер выходного кадра. Для размеров, которые пин предлагает приложениям,
+// ширина и высота — константы времени компиляции: число итераций строки,
+// отсутствие хвоста и смещения плоскостей известны компилятору.
+template <int W, int H>
+struct FixedSize
+{
+    static_assert(W % 32 == 0 && H % 2 == 0, "векторные циклы проходят строку без хвоста");
+    constexpr int Width() const { return W; }
+    constexpr int Height() const { return H; }
+};
+
+// Любой другой размер — общая версия того же ядра
+struct RuntimeSize
+{
+    int w;
+    int h;
+    int Width() const { return w; }
+    int Height() const { return h; }
+};
+
+// Вызывает fn(FixedSize<W, H>) для предлагаемых пином размеров,
+// иначе fn(RuntimeSize). Масштабирование на выбор не влияет: ядра
+// получают строки уже в выходном размере.
+template <class Fn>
+inline void DispatchFrameSize(const ConvertArgs& a, Fn&& fn)
+{
+    if (a.width == 1920 && a.height == 1080)     fn(FixedSize<1920, 1080>());
+    else if (a.width == 1280 && a.height == 720) fn(FixedSize<1280, 720>());
+    else if (a.width == 960 && a.height == 540)  fn(FixedSize<960, 540>());
+    else if (a.width == 640 && a.height == 480)  fn(FixedSize<640, 480>());
+    else                                         fn(RuntimeSize{ a.width, a.height });
+}
+
+// Вызывает fn(ColorSpaceTag<cs>, size) — ядро специализировано и по
+// матрице, и по размеру кадра
+template <class Fn>
+inline void DispatchKernel(const ConvertArgs& a, Fn&& fn)
+{
+    DispatchColorSpace(a.colorSpace, [&](auto cs)
+    {
+        DispatchFrameSize(a, [&](auto size) { fn(cs, size); });
+    });
+}
+
+#if VCAM_X86_SIMD
+template <bool S>
+using StreamTag = std::integral_constant<bool, S>;
+
+// Вызывает fn(StreamTag<true>), если кадр frameBytes пишется в обход кэша,
+// иначе fn(StreamTag<false>). Потоковая запись требует выровненных начал
+// строк всех плоскостей: хватает dst и ширины, кратных 32. После неё —
+// sfence: полоса должна быть видна другим потокам до того, как пул
+// сообщит о готовности кадра.
+template <class Fn>
+inline void DispatchStoreMode(const ConvertArgs& a, size_t frameBytes, Fn&& fn)
+{
+    const bool aligned = (reinterpret_cast<uintptr_t>(a.dst) & 31) == 0 && (a.width & 31) == 0;
+    const bool stream = aligned &&
+        (a.store == StoreMode::Streaming ||
+         (a.store == StoreMode::Auto && frameBytes > StreamingStoreThreshold()));
+    if (stream)
+    {
+        fn(StreamTag<true>());
+        _mm_sfence();
+    }
+    else
+    {
+        fn(StreamTag<false>());
+    }
+}
+
+// Запись 16 байт: в обход кэша (адрес тогда выровнен) или обычная
+template <bool Stream>
+inline void Store16(uint8_t* p, __m128i v)
+{
+    if (Stream)
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p), v);
+    else
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+}
+#endif
+
+// RGB -> YUV. В полном диапазоне цветность на краю может дать 256 —
+// отсюда Clamp255 (SIMD-ядра насыщают так же).
+template <ColorSpace CS>
+inline uint8_t RGB2Y(int R, int G, int B)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    return static_cast<uint8_t>(((c.yr * R + c.yg * G + c.yb * B + 128) >> 8) + c.yOffset);
+}
+
+template <ColorSpace CS>
+inline uint8_t RGB2U(int R, int G, int B)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    return Clamp255(((c.ur * R + c.ug * G + c.ub * B + 128) >> 8) + 128);
+}
+
+template <ColorSpace CS>
+inline uint8_t RGB2V(int R, int G, int B)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    return Clamp255(((c.vr * R + c.vg * G + c.vb * B + 128) >> 8) + 128);
+}
+
+// YUV -> BGR
+template <ColorSpace CS>
+inline void YUV2BGR(int Y, int U, int V, uint8_t* o)
+{
+    constexpr YuvCoeffs c = Coeffs<CS>();
+    const int l = c.yScale * (Y - c.yOffset) + 128;
+    const int d = U - 128;
+    const int e = V - 128;
+    o[0] = Clamp255((l + c.bu * d) >> 8);
+    o[1] = Clamp255((l - c.gu * d - c.gv * e) >> 8);
+    o[2] = Clamp255((l + c.rv * e) >> 8);
+}
+
+// Строка y источника (сверху вниз) с учётом переворота
+inline const uint8_t* SrcRow(const ConvertArgs& a, int y)
+{
+    const int srcY = a.flipV ? a.srcHeight - 1 - y : y;
+    return a.src + static_cast<intptr_t>(srcY) * a.srcStride;
+}
+
+// Конец полосы выходных строк
+inline int RowEnd(const ConvertArgs& a, int height)
+{
+    return (a.rowEnd > 0 && a.rowEnd < height) ? a.rowEnd : height;
+}
+
+inline int RowEnd(const ConvertArgs& a)
+{
+    return RowEnd(a, a.height);
+}
+
+// out = a * (256 - w) / 256 + b * w / 256, w в [0, 256]
+inline void BlendRows(const uint8_t* a, const uint8_t* b, uint8_t* out, int bytes, int w)
+{
+    int i = 0;
+#if VCAM_X86_SIMD
+    const __m128i z  = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(256 - w));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(w));
+    const __m128i rnd = _mm_set1_epi16(128);
+    for (; i + 16 <= bytes; i += 16)
+    {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        // 255 * 256 + 128 помещается в беззнаковое 16-битное слово
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, z), wa), _mm_mullo_epi16(_mm_unpacklo_epi8(vb, z), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, z), wa), _mm_mullo_epi16(_mm_unpackhi_epi8(vb, z), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, rnd), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, rnd), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+    for (; i < bytes; ++i)
+        out[i] = static_cast<uint8_t>((a[i] * (256 - w) + b[i] * w + 128) >> 8);
+}
+
+// Координата источника для выходной позиции в 16.16 с выравниванием центров
+// пикселей: (i + 0.5) * src / dst - 0.5. Возвращает индекс и вес соседа (0..255).
+inline void SamplePos(int64_t step, int i, int srcSize, int& idx, int& frac)
+{
+    int64_t pos = step * i + step / 2 - 32768;
+    if (pos < 0) pos = 0;
+    idx  = static_cast<int>(pos >> 16);
+    frac = static_cast<int>((pos >> 8) & 0xFF);
+    if (idx >= srcSize - 1)
+    {
+        idx  = srcSize - 1;
+        frac = 0;
+    }
+}
+
+inline void ResamplePixelBGR24_Scalar(const uint8_t* src, const ScaleTables& t, uint8_t* o, int x)
+{
+    const uint8_t* p = src + t.bgrOffset[x];
+    const int g = t.lumaX.weights[x] & 0xFFFF;
+    const int f = t.lumaX.weights[x] >> 16;
+    const uint8_t* q = f ? p + 3 : p;
+    o[0] = static_cast<uint8_t>((p[0] * g + q[0] * f + 128) >> 8);
+    o[1] = static_cast<uint8_t>((p[1] * g + q[1] * f + 128) >> 8);
+    o[2] = static_cast<uint8_t>((p[2] * g + q[2] * f + 128) >> 8);
+}
+
+// Горизонтальное билинейное масштабирование строки BGR24. Векторные ветви
+// пишут по 4 байта на пиксель внахлёст, поэтому у dst нужен запас в 32 байта.
+inline void ResampleRowBGR24(const uint8_t* src, const ScaleTables& t, uint8_t* dst, int dstW)
+{
+    int x = 0;
+#if defined(__AVX2__)
+    // 8 пикселей за проход: два gather'а дают левых и правых соседей,
+    // pmaddwd считает a * (256 - f) + b * f сразу для пары байтов
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i rnd = _mm256_set1_epi32(128);
+    const __m256i compact = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    const int simd8 = t.bgrSimdCount & ~7;
+    for (; x < simd8; x += 8)
+    {
+        const __m256i idx = _mm256_load_si256(reinterpret_cast<const __m256i*>(t.bgrOffset + x));
+        const __m256i w   = _mm256_load_si256(reinterpret_cast<const __m256i*>(t.lumaX.weights + x));
+        const __m256i a = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src), idx, 1);
+        const __m256i b = _mm256_i32gather_epi32(reinterpret_cast<const int*>(src + 3), idx, 1);
+        const __m256i lo = _mm256_unpacklo_epi8(a, b);   // пиксели 0,1 | 4,5
+        const __m256i hi = _mm256_unpackhi_epi8(a, b);   // пиксели 2,3 | 6,7
+
+        __m256i m0 = _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, z), _mm256_shuffle_epi32(w, 0x00));
+        __m256i m1 = _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, z), _mm256_shuffle_epi32(w, 0x55));
+        __m256i m2 = _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, z), _mm256_shuffle_epi32(w, 0xAA));
+        __m256i m3 = _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, z), _mm256_shuffle_epi32(w, 0xFF));
+        m0 = _mm256_srli_epi32(_mm256_add_epi32(m0, rnd), 8);
+        m1 = _mm256_srli_epi32(_mm256_add_epi32(m1, rnd), 8);
+        m2 = _mm256_srli_epi32(_mm256_add_epi32(m2, rnd), 8);
+        m3 = _mm256_srli_epi32(_mm256_add_epi32(m3, rnd), 8);
+
+        // BGRx для пикселей 0..3 | 4..7 -> по 12 байт BGR в каждой половине
+        const __m256i px = _mm256_shuffle_epi8(
+            _mm256_packus_epi16(_mm256_packs_epi32(m0, m1), _mm256_packs_epi32(m2, m3)), compact);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3),      _mm256_castsi256_si128(px));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 3 + 12), _mm256_extracti128_si256(px, 1));
+    }
+#elif VCAM_X86_SIMD
+    const __m128i z = _mm_setzero_si128();
+    const __m128i rnd = _mm_set1_epi32(128);
+    for (; x < t.bgrSimdCount; ++x)
+    {
+        // B0 B1 G0 G1 R0 R1 .. — пары соседей для pmaddwd
+        const __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + t.bgrOffset[x]));
+        const __m128i pairs = _mm_unpacklo_epi8(_mm_unpacklo_epi8(v, _mm_srli_si128(v, 3)), z);
+        __m128i m = _mm_madd_epi16(pairs, _mm_set1_epi32(t.lumaX.weights[x]));
+        m = _mm_srli_epi32(_mm_add_epi32(m, rnd), 8);
+        const int bgrx = _mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(m, z), z));
+        memcpy(dst + x * 3, &bgrx, 4);
+    }
+#endif
+    for (; x < dstW; ++x)
+        ResamplePixelBGR24_Scalar(src, t, dst + x * 3, x);
+}
+
+// Выдаёт строки BGR24 уже в выходном размере. Без масштабирования — указатели
+// прямо в кадр источника, иначе смешивает две строки источника по вертикали
+// и масштабирует результат по горизонтали во временный буфер. slot (0/1)
+// позволяет держать две строки одновременно для ядер 4:2:0.
+class RowSource
+{
+public:
+    explicit RowSource(const ConvertArgs& a)
+        : m_a(a),
+          m_scaleX(a.srcWidth != a.width),
+          m_scaleY(a.srcHeight != a.height)
+    {
+        if (!m_scaleX && !m_scaleY)
+            return;
+        m_tables = &ScaleTablesFor(a);
+        m_blendBytes = a.srcWidth * 3;
+        const size_t blendBytes = static_cast<size_t>(m_blendBytes) + 32;
+        const size_t outBytes   = static_cast<size_t>(a.width) * 3 + 32;
+        uint8_t* scratch = ScaleScratch(2 * blendBytes + 2 * outBytes);
+        m_blend[0]   = scratch;
+        m_blend[1]   = m_blend[0] + blendBytes;
+        m_resized[0] = m_blend[1] + blendBytes;
+        m_resized[1] = m_resized[0] + outBytes;
+    }
+
+    const uint8_t* Row(int y, int slot)
+    {
+        if (!m_scaleY)
+        {
+            const uint8_t* row = SrcRow(m_a, y);
+            return m_scaleX ? Resize(row, slot) : row;
+        }
+
+        const int y0 = m_tables->lumaY.index[y];
+        const int f  = m_tables->lumaY.weights[y] >> 16;
+        const uint8_t* row = SrcRow(m_a, y0);
+        if (f)
+        {
+            BlendRows(row, SrcRow(m_a, y0 + 1), m_blend[slot], m_blendBytes, f);
+            row = m_blend[slot];
+        }
+        return m_scaleX ? Resize(row, slot) : row;
+    }
+
+private:
+    const uint8_t* Resize(const uint8_t* row, int slot)
+    {
+        ResampleRowBGR24(row, *m_tables, m_resized[slot], m_a.width);
+        return m_resized[slot];
+    }
+
+    const ConvertArgs& m_a;
+    bool        m_scaleX;
+    bool        m_scaleY;
+    const ScaleTables* m_tables = nullptr;
+    int         m_blendBytes = 0;
+    uint8_t*    m_blend[2] = {};
+    uint8_t*    m_resized[2] = {};
+};
+
+// Цветность считается по среднему цвету блока: 2×2 для 4:2:0, пары
+// пикселей для 4:2:2. Среднее округляется до целого в каждом канале, и
+// SIMD-ядра делают то же самое — результат совпадает бит в бит.
+inline int Box2x2(const uint8_t* p0, const uint8_t* p1, int c)
+{
+    return (p0[c] + p0[c + 3] + p1[c] + p1[c + 3] + 2) >> 2;
+}
+
+inline int Box2x1(const uint8_t* p, int c)
+{
+    return (p[c] + p[c + 3] + 1) >> 1;
+}
+
+// Пара строк BGR24 -> две строки Y и одна строка UV (NV12), начиная с x0
+template <ColorSpace CS>
+inline void BGR24ToNV12RowPair_Scalar(const uint8_t* s0, const uint8_t* s1,
+                                      uint8_t* y0, uint8_t* y1, uint8_t* uv,
+                                      int x0, int width)
+{
+    for (int x = x0; x < width; x += 2)
+    {
+        const uint8_t* p0 = s0 + x * 3;
+        const uint8_t* p1 = s1 + x * 3;
+        y0[x]     = RGB2Y<CS>(p0[2], p0[1], p0[0]);
+        y0[x + 1] = RGB2Y<CS>(p0[5], p0[4], p0[3]);
+        y1[x]     = RGB2Y<CS>(p1[2], p1[1], p1[0]);
+        y1[x + 1] = RGB2Y<CS>(p1[5], p1[4], p1[3]);
+        const int B = Box2x2(p0, p1, 0), G = Box2x2(p0, p1, 1), R = Box2x2(p0, p1, 2);
+        uv[x]     = RGB2U<CS>(R, G, B);
+        uv[x + 1] = RGB2V<CS>(R, G, B);
+    }
+}
+
+// Пара строк BGR24 -> две строки Y и строки U, V (I420), начиная с x0
+template <ColorSpace CS>
+inline void BGR24ToI420RowPair_Scalar(const uint8_t* s0, const uint8_t* s1,
+                                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v,
+                                      int x0, int width)
+{
+    for (int x = x0; x < width; x += 2)
+    {
+        const uint8_t* p0 = s0 + x * 3;
+        const uint8_t* p1 = s1 + x * 3;
+        y0[x]     = RGB2Y<CS>(p0[2], p0[1], p0[0]);
+        y0[x + 1] = RGB2Y<CS>(p0[5], p0[4], p0[3]);
+        y1[x]     = RGB2Y<CS>(p1[2], p1[1], p1[0]);
+        y1[x + 1] = RGB2Y<CS>(p1[5], p1[4], p1[3]);
+        const int B = Box2x2(p0, p1, 0), G = Box2x2(p0, p1, 1), R = Box2x2(p0, p1, 2);
+        u[x / 2]  = RGB2U<CS>(R, G, B);
+        v[x / 2]  = RGB2V<CS>(R, G, B);
+    }
+}
+
+// Строка BGR24 -> строка YUY2, начиная с x0. Цветность — по среднему пары.
+template <ColorSpace CS>
+inline void BGR24ToYUY2Row_Scalar(const uint8_t* s, uint8_t* d, int x0, int width)
+{
+    for (int x = x0; x < width; x += 2)
+    {
+        const uint8_t* p = s + x * 3;
+        uint8_t* o = d + x * 2;
+        const int B = Box2x1(p, 0), G = Box2x1(p, 1), R = Box2x1(p, 2);
+        o[0] = RGB2Y<CS>(p[2], p[1], p[0]);
+        o[1] = RGB2U<CS>(R, G, B);
+        o[2] = RGB2Y<CS>(p[5], p[4], p[3]);
+        o[3] = RGB2V<CS>(R, G, B);
+    }
+}
+
+// Обходит полосу кадра парами строк и вызывает ядро для каждой пары.
+// Size — FixedSize или RuntimeSize из DispatchFrameSize.
+// RowPair: (s0, s1, y0, y1, uv, width)
+template <class Size, class RowPair>
+inline void ForEachRowPairNV12(const ConvertArgs& a, Size size, RowPair rowPair)
+{
+    const int w = size.Width();
+    const int h = size.Height();
+    uint8_t* yPlane  = a.dst;
+    uint8_t* uvPlane = a.dst + static_cast<intptr_t>(w) * h;
+    RowSource rows(a);
+    const int yEnd = RowEnd(a, h);
+    for (int y = a.rowBegin; y < yEnd; y += 2)
+    {
+        const int y1 = (y + 1 < h) ? y + 1 : y;
+        rowPair(rows.Row(y, 0), rows.Row(y1, 1),
+                yPlane + static_cast<intptr_t>(y) * w,
+                yPlane + static_cast<intptr_t>(y1) * w,
+                uvPlane + static_cast<intptr_t>(y / 2) * w, w);
+    }
+}
+
+// То же для I420. RowPair: (s0, s1, y0, y1, u, v, width)
+template <class Size, class RowPair>
+inline void ForEachRowPairI420(const ConvertArgs& a, Size size, RowPair rowPair)
+{
+    const int w = size.Width();
+    const int h = size.Height();
+    const intptr_t chromaStride = w / 2;
+    uint8_t* yPlane = a.dst;
+    uint8_t* uPlane = a.dst + static_cast<intptr_t>(w) * h;
+    uint8_t* vPlane = uPlane + chromaStride * (h / 2);
+    RowSource rows(a);
+    const int yEnd = RowEnd(a, h);
+    for (int y = a.rowBegin; y < yEnd; y += 2)
+    {
+        const int y1 = (y + 1 < h) ? y + 1 : y;
+        rowPair(rows.Row(y, 0), rows.Row(y1, 1),
+                yPlane + static_cast<intptr_t>(y) * w,
+                yPlane + static_cast<intptr_t>(y1) * w,
+                uPlane + chromaStride * (y / 2),
+                vPlane + chromaStride * (y / 2), w);
+    }
+}
+
+// Построчный обход для упакованных форматов. Row: (s, d, width)
+template <class Size, class Row>
+inline void ForEachRow(const ConvertArgs& a, Size size, int dstBytesPerPixel, Row row)
+{
+    const int w = size.Width();
+    const intptr_t dstStride = static_cast<intptr_t>(w) * dstBytesPerPixel;
+    RowSource rows(a);
+    const int yEnd = RowEnd(a, size.Height());
+    for (int y = a.rowBegin; y < yEnd; ++y)
+        row(rows.Row(y, 0), a.dst + dstStride * y, w);
+}
+
+template <class Row>
+inline void ForEachRow(const ConvertArgs& a, int dstBytesPerPixel, Row row)
+{
+    ForEachRow(a, RuntimeSize{ a.width, a.height }, dstBytesPerPixel, row);
+}
+
+} // namespace
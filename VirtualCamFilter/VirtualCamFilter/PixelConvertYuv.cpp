@@ -0,0 +1,372 @@
+// Ядра для кадров, которые писатель присылает уже в YUV 4:2:0 (NV12, I420).
+// В родном размере это копирование плоскостей или перестановка байтов
+// цветности; при другом размере плоскости масштабируются билинейно построчно,
+// как BGR24 в RowSource. Если матрица или диапазон выхода отличаются от
+// источника, отсчёты после копирования пересчитываются (YuvMatrix).
+// Собирается без pch.h, как и PixelConvert.cpp.
+#include "PixelConvertImpl.h"
+#include <cstring>
+
+namespace {
+
+// Плоскости источника. У NV12 u и v указывают в одну плоскость UV с шагом 2.
+struct YuvSource
+{
+    const uint8_t* y;
+    const uint8_t* u;
+    const uint8_t* v;
+    int yStride;
+    int cStride;
+    int cStep;
+};
+
+// Пересчёт YUV одной матрицы и диапазона в другие без круга через 8-битный
+// RGB, в фиксированной точке с 16 битами дробной части:
+//   Y' = (yScale*Y + yCb*(U-128) + yCr*(V-128) + yBias) >> 16
+//   U' = 128 + (cbCb*(U-128) + cbCr*(V-128) + half) >> 16, V' — так же
+// Яркость зависит от цветности: у матриц разные веса R, G, B.
+struct YuvMatrix
+{
+    bool identity;
+    int yScale, yCb, yCr, yBias;
+    int cbCb, cbCr, crCb, crCr;
+};
+
+YuvMatrix MakeYuvMatrix(ColorSpace from, ColorSpace to)
+{
+    YuvMatrix m = {};
+    m.identity = from == to;
+    if (m.identity)
+        return m;
+
+    struct Desc { double kr, kb, yOff, yRange, cRange; };
+    const auto describe = [](ColorSpace cs)
+    {
+        const bool bt709 = cs == ColorSpace::BT709Limited || cs == ColorSpace::BT709Full;
+        const bool full  = cs == ColorSpace::BT601Full || cs == ColorSpace::BT709Full;
+        return Desc{ bt709 ? 0.2126 : 0.299, bt709 ? 0.0722 : 0.114,
+                     full ? 0.0 : 16.0, full ? 255.0 : 219.0, full ? 255.0 : 224.0 };
+    };
+    const Desc s = describe(from);
+    const Desc d = describe(to);
+
+    // Нормированные Y, Cb, Cr источника -> RGB -> нормированные выхода.
+    // Линейно, поэтому достаточно прогнать единичные Cb и Cr; Y переходит в Y.
+    const auto convert = [&](double cb, double cr, double& ocb, double& ocr, double& oy)
+    {
+        const double skg = 1.0 - s.kr - s.kb;
+        const double r = 2 * (1 - s.kr) * cr;
+        const double b = 2 * (1 - s.kb) * cb;
+        const double g = -(2 * (1 - s.kb) * s.kb / skg) * cb - (2 * (1 - s.kr) * s.kr / skg) * cr;
+        oy  = d.kr * r + (1.0 - d.kr - d.kb) * g + d.kb * b;
+        ocb = (b - oy) / (2 * (1 - d.kb));
+        ocr = (r - oy) / (2 * (1 - d.kr));
+    };
+    double yCb, cbCb, crCb, yCr, cbCr, crCr;
+    convert(1, 0, cbCb, crCb, yCb);
+    convert(0, 1, cbCr, crCr, yCr);
+
+    const auto fixed = [](double v) { return static_cast<int>(v < 0 ? v * 65536 - 0.5 : v * 65536 + 0.5); };
+    const double yScale = d.yRange / s.yRange;
+    const double cScale = d.cRange / s.cRange;
+    m.yScale = fixed(yScale);
+    m.yCb    = fixed(d.yRange * yCb / s.cRange);
+    m.yCr    = fixed(d.yRange * yCr / s.cRange);
+    m.yBias  = fixed(d.yOff - s.yOff * yScale) + 32768;
+    m.cbCb   = fixed(cScale * cbCb);
+    m.cbCr   = fixed(cScale * cbCr);
+    m.crCb   = fixed(cScale * crCb);
+    m.crCr   = fixed(cScale * crCr);
+    return m;
+}
+
+// Пересчитывает отсчёты Y, делящие одну пару u/v, и саму пару (на месте)
+inline void ApplyYuvMatrix(const YuvMatrix& m, uint8_t* const* ys, int count, uint8_t& u, uint8_t& v)
+{
+    const int du = u - 128;
+    const int dv = v - 128;
+    const int yc = m.yCb * du + m.yCr * dv + m.yBias;
+    for (int i = 0; i < count; ++i)
+        *ys[i] = Clamp255((m.yScale * *ys[i] + yc) >> 16);
+    u = Clamp255(128 + ((m.cbCb * du + m.cbCr * dv + 32768) >> 16));
+    v = Clamp255(128 + ((m.crCb * du + m.crCr * dv + 32768) >> 16));
+}
+
+inline YuvSource NV12Source(const ConvertArgs& a)
+{
+    const uint8_t* uv = a.src + static_cast<intptr_t>(a.srcStride) * a.srcHeight;
+    return { a.src, uv, uv + 1, a.srcStride, a.srcStride, 2 };
+}
+
+inline YuvSource I420Source(const ConvertArgs& a)
+{
+    const int cStride = a.srcStride / 2;
+    const uint8_t* u = a.src + static_cast<intptr_t>(a.srcStride) * a.srcHeight;
+    const uint8_t* v = u + static_cast<intptr_t>(cStride) * (a.srcHeight / 2);
+    return { a.src, u, v, a.srcStride, cStride, 1 };
+}
+
+// Горизонтальное билинейное масштабирование строки одной плоскости по
+// таблице оси; отсчёты источника идут через srcStep байт
+inline void ResampleRowPlane(const uint8_t* src, int srcStep, const ScaleAxis& axis, uint8_t* dst, int dstW)
+{
+    for (int x = 0; x < dstW; ++x)
+    {
+        const uint8_t* p = src + axis.index[x] * srcStep;
+        const int f = axis.weights[x] >> 16;
+        dst[x] = f ? static_cast<uint8_t>((p[0] * (256 - f) + p[srcStep] * f + 128) >> 8) : p[0];
+    }
+}
+
+// Выдаёт строки Y и строки цветности уже в выходном размере и с учётом
+// переворота. Без масштабирования — указатели прямо в кадр источника.
+class YuvRowSource
+{
+public:
+    YuvRowSource(const ConvertArgs& a, const YuvSource& s)
+        : m_a(a), m_s(s), m_scale(a.srcWidth != a.width || a.srcHeight != a.height)
+    {
+        if (!m_scale)
+            return;
+        m_tables = &ScaleTablesFor(a);
+        // Смешанная строка: Y, либо UV целиком (NV12), либо U и V (I420)
+        const size_t blendBytes = static_cast<size_t>(a.srcWidth) + 32;
+        const size_t outBytes   = static_cast<size_t>(a.width) + 32;
+        uint8_t* scratch = ScaleScratch(2 * blendBytes + 2 * outBytes);
+        m_blend[0] = scratch;
+        m_blend[1] = m_blend[0] + blendBytes;
+        m_y = m_blend[1] + blendBytes;
+        m_u = m_y + outBytes;
+        m_v = m_u + outBytes / 2;
+    }
+
+    const uint8_t* Y(int y)
+    {
+        const int yy = m_a.flipV ? m_a.height - 1 - y : y;
+        if (!m_scale)
+            return m_s.y + static_cast<intptr_t>(yy) * m_s.yStride;
+
+        const int y0 = m_tables->lumaY.index[yy];
+        const int f  = m_tables->lumaY.weights[yy] >> 16;
+        const uint8_t* row = m_s.y + static_cast<intptr_t>(y0) * m_s.yStride;
+        if (f)
+        {
+            BlendRows(row, row + m_s.yStride, m_blend[0], m_a.srcWidth, f);
+            row = m_blend[0];
+        }
+        ResampleRowPlane(row, 1, m_tables->lumaX, m_y, m_a.width);
+        return m_y;
+    }
+
+    // Строка цветности cy (выходная, 0..height/2): u[x * step], v[x * step]
+    void Chroma(int cy, const uint8_t*& u, const uint8_t*& v, int& step)
+    {
+        const int ch = m_a.height / 2;
+        const int cyy = m_a.flipV ? ch - 1 - cy : cy;
+        if (!m_scale)
+        {
+            u = m_s.u + static_cast<intptr_t>(cyy) * m_s.cStride;
+            v = m_s.v + static_cast<intptr_t>(cyy) * m_s.cStride;
+            step = m_s.cStep;
+            return;
+        }
+
+        const int srcCW = m_a.srcWidth / 2;
+        const int c0 = m_tables->chromaY.index[cyy];
+        const int f  = m_tables->chromaY.weights[cyy] >> 16;
+        const uint8_t* ru = m_s.u + static_cast<intptr_t>(c0) * m_s.cStride;
+        const uint8_t* rv = m_s.v + static_cast<intptr_t>(c0) * m_s.cStride;
+        if (f)
+        {
+            if (m_s.cStep == 2)
+            {
+                // UV чередуются — смешиваем строку целиком
+                BlendRows(ru, ru + m_s.cStride, m_blend[0], srcCW * 2, f);
+                ru = m_blend[0];
+                rv = m_blend[0] + 1;
+            }
+            else
+            {
+                BlendRows(ru, ru + m_s.cStride, m_blend[0], srcCW, f);
+                BlendRows(rv, rv + m_s.cStride, m_blend[1], srcCW, f);
+                ru = m_blend[0];
+                rv = m_blend[1];
+            }
+        }
+        ResampleRowPlane(ru, m_s.cStep, m_tables->chromaX, m_u, m_a.width / 2);
+        ResampleRowPlane(rv, m_s.cStep, m_tables->chromaX, m_v, m_a.width / 2);
+        u = m_u;
+        v = m_v;
+        step = 1;
+    }
+
+private:
+    const ConvertArgs& m_a;
+    YuvSource   m_s;
+    bool        m_scale;
+    const ScaleTables* m_tables = nullptr;
+    uint8_t*    m_blend[2] = {};
+    uint8_t*    m_y = nullptr;
+    uint8_t*    m_u = nullptr;
+    uint8_t*    m_v = nullptr;
+};
+
+void YuvToNV12(const ConvertArgs& a, const YuvSource& s)
+{
+    const int w = a.width;
+    uint8_t* yPlane  = a.dst;
+    uint8_t* uvPlane = a.dst + static_cast<intptr_t>(w) * a.height;
+    const YuvMatrix m = MakeYuvMatrix(a.srcColorSpace, a.colorSpace);
+    YuvRowSource rows(a, s);
+    const int yEnd = RowEnd(a);
+    for (int y = a.rowBegin; y < yEnd; y += 2)
+    {
+        uint8_t* y0 = yPlane + static_cast<intptr_t>(y) * w;
+        uint8_t* y1 = y0 + w;
+        memcpy(y0, rows.Y(y), w);
+        memcpy(y1, rows.Y(y + 1), w);
+
+        const uint8_t* u;
+        const uint8_t* v;
+        int step;
+        rows.Chroma(y / 2, u, v, step);
+        uint8_t* uv = uvPlane + static_cast<intptr_t>(y / 2) * w;
+        if (step == 2 && v == u + 1)
+        {
+            memcpy(uv, u, w);   // уже NV12
+        }
+        else
+        {
+            for (int x = 0; x < w / 2; ++x)
+            {
+                uv[2 * x]     = u[x * step];
+                uv[2 * x + 1] = v[x * step];
+            }
+        }
+
+        if (m.identity)
+            continue;
+        for (int x = 0; x < w / 2; ++x)
+        {
+            uint8_t* const block[] = { y0 + 2 * x, y0 + 2 * x + 1, y1 + 2 * x, y1 + 2 * x + 1 };
+            ApplyYuvMatrix(m, block, 4, uv[2 * x], uv[2 * x + 1]);
+        }
+    }
+}
+
+void YuvToI420(const ConvertArgs& a, const YuvSource& s)
+{
+    const int w = a.width;
+    const intptr_t chromaStride = w / 2;
+    uint8_t* yPlane = a.dst;
+    uint8_t* uPlane = a.dst + static_cast<intptr_t>(w) * a.height;
+    uint8_t* vPlane = uPlane + chromaStride * (a.height / 2);
+    const YuvMatrix m = MakeYuvMatrix(a.srcColorSpace, a.colorSpace);
+    YuvRowSource rows(a, s);
+    const int yEnd = RowEnd(a);
+    for (int y = a.rowBegin; y < yEnd; y += 2)
+    {
+        uint8_t* y0 = yPlane + static_cast<intptr_t>(y) * w;
+        uint8_t* y1 = y0 + w;
+        memcpy(y0, rows.Y(y), w);
+        memcpy(y1, rows.Y(y + 1), w);
+
+        const uint8_t* u;
+        const uint8_t* v;
+        int step;
+        rows.Chroma(y / 2, u, v, step);
+        uint8_t* du = uPlane + chromaStride * (y / 2);
+        uint8_t* dv = vPlane + chromaStride * (y / 2);
+        if (step == 1)
+        {
+            memcpy(du, u, chromaStride);
+            memcpy(dv, v, chromaStride);
+        }
+        else
+        {
+            for (int x = 0; x < w / 2; ++x)
+            {
+                du[x] = u[x * step];
+                dv[x] = v[x * step];
+            }
+        }
+
+        if (m.identity)
+            continue;
+        for (int x = 0; x < w / 2; ++x)
+        {
+            uint8_t* const block[] = { y0 + 2 * x, y0 + 2 * x + 1, y1 + 2 * x, y1 + 2 * x + 1 };
+            ApplyYuvMatrix(m, block, 4, du[x], dv[x]);
+        }
+    }
+}
+
+void YuvToYUY2(const ConvertArgs& a, const YuvSource& s)
+{
+    const int w = a.width;
+    const YuvMatrix m = MakeYuvMatrix(a.srcColorSpace, a.colorSpace);
+    YuvRowSource rows(a, s);
+    const int yEnd = RowEnd(a);
+    for (int y = a.rowBegin; y < yEnd; ++y)
+    {
+        const uint8_t* ys = rows.Y(y);
+        const uint8_t* u;
+        const uint8_t* v;
+        int step;
+        rows.Chroma(y / 2, u, v, step);
+        uint8_t* o = a.dst + static_cast<intptr_t>(y) * w * 2;
+        for (int x = 0; x < w / 2; ++x)
+        {
+            o[4 * x]     = ys[2 * x];
+            o[4 * x + 1] = u[x * step];
+            o[4 * x + 2] = ys[2 * x + 1];
+            o[4 * x + 3] = v[x * step];
+        }
+
+        // Цветность у каждой строки своя копия — пересчитываем построчно
+        if (m.identity)
+            continue;
+        for (int x = 0; x < w / 2; ++x)
+        {
+            uint8_t* const pair[] = { o + 4 * x, o + 4 * x + 2 };
+            ApplyYuvMatrix(m, pair, 2, o[4 * x + 1], o[4 * x + 3]);
+        }
+    }
+}
+
+template <ColorSpace CS>
+void YuvToBGR24(const ConvertArgs& a, const YuvSource& s)
+{
+    const int w = a.width;
+    YuvRowSource rows(a, s);
+    const int yEnd = RowEnd(a);
+    for (int y = a.rowBegin; y < yEnd; ++y)
+    {
+        const uint8_t* ys = rows.Y(y);
+        const uint8_t* u;
+        const uint8_t* v;
+        int step;
+        rows.Chroma(y / 2, u, v, step);
+        uint8_t* o = a.dst + static_cast<intptr_t>(y) * w * 3;
+        for (int x = 0; x < w; ++x)
+            YUV2BGR<CS>(ys[x], u[(x / 2) * step], v[(x / 2) * step], o + x * 3);
+    }
+}
+
+} // namespace
+
+void ConvertNV12ToNV12_Scalar(const ConvertArgs& a)  { YuvToNV12(a, NV12Source(a)); }
+void ConvertNV12ToI420_Scalar(const ConvertArgs& a)  { YuvToI420(a, NV12Source(a)); }
+void ConvertNV12ToYUY2_Scalar(const ConvertArgs& a)  { YuvToYUY2(a, NV12Source(a)); }
+void ConvertNV12ToBGR24_Scalar(const ConvertArgs& a)
+{
+    DispatchColorSpace(a.srcColorSpace, [&](auto cs) { YuvToBGR24<decltype(cs)::value>(a, NV12Source(a)); });
+}
+
+void ConvertI420ToNV12_Scalar(const ConvertArgs& a)  { YuvToNV12(a, I420Source(a)); }
+void ConvertI420ToI420_Scalar(const ConvertArgs& a)  { YuvToI420(a, I420Source(a)); }
+void ConvertI420ToYUY2_Scalar(const ConvertArgs& a)  { YuvToYUY2(a, I420Source(a)); }
+void ConvertI420ToBGR24_Scalar(const ConvertArgs& a)
+{
+    DispatchColorSpace(a.srcColorSpace, [&](auto cs) { YuvToBGR24<decltype(cs)::value>(a, I420Source(a)); });
+}
@@ -1,57 +1,663 @@
 #pragma once
 #include <windows.h>
 #include <atomic>
+#include <cwchar>
 
-// Константы Full HD кадра (BGR24)
+// Формат по умолчанию: в нём пин объявляет себя приложениям, и под него
+// писатель обычно выделяет слоты. Фактический формат каждого кадра
+// записан в его слоте (см. SharedSlot).
 constexpr DWORD FRAME_W   = 1920;
 constexpr DWORD FRAME_H   = 1080;
 constexpr DWORD FRAME_BPP = 3;        // BGR24
 constexpr DWORD FRAME_SZ  = FRAME_W * FRAME_H * FRAME_BPP; // 6 220 800 байт
 
-// Структура, лежащая в разделяемой памяти
+// FourCC: младший байт — первый символ
+constexpr DWORD ShmFourCC(char a, char b, char c, char d)
+{
+    return static_cast<DWORD>(static_cast<BYTE>(a)) | (static_cast<DWORD>(static_cast<BYTE>(b)) << 8) |
+           (static_cast<DWORD>(static_cast<BYTE>(c)) << 16) | (static_cast<DWORD>(static_cast<BYTE>(d)) << 24);
+}
+
+// Сигнатура и версия раскладки разделяемой памяти, допустимое число слотов
+// кольца. Писатель выбирает число слотов и их размер сам, фильтр берёт их из
+// заголовка. Память с другой сигнатурой или версией фильтр не читает вовсе.
+constexpr DWORD SHM_MAGIC     = ShmFourCC('v', 'C', 'a', 'm');
+constexpr DWORD SHM_VERSION   = 6;
+constexpr DWORD SHM_MIN_SLOTS = 3;
+constexpr DWORD SHM_MAX_SLOTS = 8;
+constexpr DWORD SHM_MAX_READERS = 16;  // записей в таблице читателей
+// Читатель, не обновлявший heartbeat дольше, не считается активным
+// (процесс завис или упал, не сняв флаг)
+constexpr ULONGLONG SHM_READER_TIMEOUT_MS = 2000;
+
+// Поля, которые пишут разные процессы, лежат в разных строках кэша. Данные
+// кадров начинаются с границы страницы, размер слота кратен странице.
+constexpr DWORD SHM_CACHE_LINE = 64;
+constexpr DWORD SHM_PAGE       = 4096;
+
+// Форматы кадра в слоте. YUV (NV12, I420) — BT.601 в полном диапазоне
+// 0..255, как у декодированного JPEG; другого писатель не присылает.
+// BGR24, строки снизу вверх (как в DIB), stride — шаг строки в байтах
+constexpr DWORD SHM_FOURCC_BGR24 = ShmFourCC('B', 'G', 'R', '3');
+// NV12: плоскость Y (stride × height), за ней UV (stride × height/2), сверху вниз
+constexpr DWORD SHM_FOURCC_NV12  = ShmFourCC('N', 'V', '1', '2');
+// I420: плоскость Y (stride × height), за ней U и V (stride/2 × height/2), сверху вниз
+constexpr DWORD SHM_FOURCC_I420  = ShmFourCC('I', '4', '2', '0');
+// MJPG: сжатый кадр JPEG целиком, size — длина потока, stride не используется
+constexpr DWORD SHM_FOURCC_MJPG  = ShmFourCC('M', 'J', 'P', 'G');
+// YUY2 встречается только в записи читателя: писатель такие кадры не присылает
+constexpr DWORD SHM_FOURCC_YUY2  = ShmFourCC('Y', 'U', 'Y', '2');
+
+// Флаг MapViewOfFile для секций SEC_LARGE_PAGES (Windows 10 1703+), в
+// старых SDK его нет
+#ifndef FILE_MAP_LARGE_PAGES
+#define FILE_MAP_LARGE_PAGES 0x20000000
+#endif
+
+// Именованные объекты, общие с писателем
+#define VCAM_SHM_NAME   L"Global\\vCamShm"
+// Событие кадра у каждого читателя своё: одно авто-сбрасываемое будило бы
+// только один процесс из нескольких, а ручное пришлось бы кому-то сбрасывать.
+// Читатель создаёт авто-сбрасываемое событие с именем по своему pid и номеру
+// записи в таблице читателей, писатель после публикации кадра взводит
+// события всех занятых записей.
+#define VCAM_EVENT_FORMAT L"Global\\vCamFrameEvent.%lu.%d"
+
+// Управляющий блок одного слота кольца, две строки кэша. В первой — то, что
+// пишет только писатель: поля формата пишутся вместе с данными кадра внутри
+// seqlock и читаются под ним же. Во второй — счётчик читателей, единственное,
+// что пишет фильтр: закрепление слота не отнимает у писателя строку с seq.
+struct SharedSlot
+{
+    // Seqlock: писатель делает счётчик нечётным перед записью и снова чётным
+    // после неё. Читатель сверяет значение до и после чтения.
+    std::atomic<LONG> seq;
+    std::atomic<LONG> frameId;      // ID кадра, лежащего в слоте
+    std::atomic<DWORD> fourcc;      // SHM_FOURCC_*
+    std::atomic<LONG> width;        // размер кадра в пикселях
+    std::atomic<LONG> height;
+    std::atomic<LONG> stride;       // шаг строки первой плоскости в байтах
+    std::atomic<DWORD> size;        // байт кадра в слоте, не больше slotSize
+    DWORD reserved0[9];
+
+    // Сколько читателей сейчас держат слот. Писатель такой слот не трогает.
+    std::atomic<LONG> readers;
+    DWORD reserved1[15];
+};
+
+// Запись таблицы читателей — один пин фильтра в любом процессе. Пишет её
+// только владелец, у каждой записи своя строка кэша. По таблице писатель
+// видит, сколько читателей живо и насколько каждый отстаёт, и возвращает
+// слоты, которые процесс закрепил и не отпустил, завершившись.
+struct SharedReader
+{
+    std::atomic<DWORD> pid;            // процесс владельца; 0 — запись свободна
+    std::atomic<LONG> lastFrameId;     // ID последнего отданного кадра
+    std::atomic<ULONGLONG> heartbeat;  // GetTickCount64() последнего отданного кадра
+    // Формат, о котором пин договорился с приёмником (SHM_FOURCC_*), и его
+    // размер — спрос на кадры писателя. Пишется при согласовании, до кадров.
+    std::atomic<DWORD> fourcc;
+    std::atomic<LONG> width;
+    std::atomic<LONG> height;
+    std::atomic<LONG> streaming;       // 1 — граф пина запущен и забирает кадры
+    std::atomic<LONG> pins[SHM_MAX_SLOTS]; // сколько раз владелец держит каждый слот
+};
+
+// Заголовок разделяемой памяти. Данные слотов начинаются со смещения
+// dataOffset от начала секции: slotCount буферов по slotSize байт.
 struct SharedHeader
 {
-    //std::atomic<LONG> frameId;   // Атомарный ID кадра // инкремент при каждом новом кадре
-    //std::atomic<DWORD> dataSize; // Атомарный размер данных // должно быть FRAME_SZ
-    //BYTE data[FRAME_SZ];
-    std::atomic<LONG> frameId;
-    std::atomic<DWORD> dataSize;
-    std::atomic<int> currentBuffer; // 0 или 1
-    BYTE data[2][FRAME_SZ];        // Два буфера
+    // Строка 0: описание раскладки, после инициализации не меняется
+    std::atomic<DWORD> magic;       // SHM_MAGIC
+    std::atomic<DWORD> version;     // SHM_VERSION; пишется последним при инициализации
+    std::atomic<DWORD> slotCount;   // SHM_MIN_SLOTS..SHM_MAX_SLOTS
+    std::atomic<DWORD> slotSize;    // ёмкость одного слота в байтах, кратна SHM_PAGE
+    std::atomic<DWORD> dataOffset;  // начало слота 0, кратно SHM_PAGE
+    DWORD reserved0[11];
+
+    // Строка 1: публикация кадра, пишет только писатель
+    std::atomic<LONG> frameId;      // ID последнего опубликованного кадра
+    std::atomic<int> currentBuffer; // слот последнего опубликованного кадра
+    DWORD reserved1[14];
+
+    SharedSlot slots[SHM_MAX_SLOTS];
+    SharedReader readerTable[SHM_MAX_READERS];
+
+    const BYTE* Data(DWORD slot) const
+    {
+        return reinterpret_cast<const BYTE*>(this) + dataOffset.load(std::memory_order_relaxed) +
+               static_cast<size_t>(slot) * slotSize.load(std::memory_order_relaxed);
+    }
+};
+static_assert(sizeof(SharedSlot) == 2 * SHM_CACHE_LINE, "раскладка общая с писателем на C#");
+static_assert(sizeof(SharedReader) == SHM_CACHE_LINE, "раскладка общая с писателем на C#");
+static_assert(sizeof(SharedHeader) == 2 * SHM_CACHE_LINE + SHM_MAX_SLOTS * sizeof(SharedSlot) +
+              SHM_MAX_READERS * sizeof(SharedReader), "раскладка общая с писателем на C#");
+static_assert(sizeof(SharedHeader) <= SHM_PAGE, "заголовок занимает одну страницу");
+
+// Для писателя: сколько пинов сейчас забирают кадры. Пока ни одного, кадры
+// можно не декодировать и не публиковать вовсе: пин при запуске графа
+// отмечает себя до первого FillBuffer, и следующий же кадр писателя снова
+// публикуется.
+inline bool ShmReaderActive(const SharedReader& r, ULONGLONG now)
+{
+    if (!r.pid.load(std::memory_order_acquire) || !r.streaming.load(std::memory_order_relaxed))
+        return false;
+    const ULONGLONG heartbeat = r.heartbeat.load(std::memory_order_acquire);
+    return heartbeat && now - heartbeat < SHM_READER_TIMEOUT_MS;
+}
+
+inline DWORD ShmActiveReaders(const SharedHeader* mem, ULONGLONG now = ::GetTickCount64())
+{
+    DWORD active = 0;
+    for (const SharedReader& r : mem->readerTable)
+    {
+        if (ShmReaderActive(r, now))
+            ++active;
+    }
+    return active;
+}
+
+// Для писателя: наибольший размер кадра, который запросили активные пины.
+// Ширина и высота берутся по отдельности, чтобы ни одному пину не пришлось
+// увеличивать кадр; публиковать кадры больше этого незачем — пины всё равно
+// уменьшат их. {0, 0} — запросов нет, размер выбирает писатель.
+struct ShmDemandSize
+{
+    LONG width;
+    LONG height;
 };
 
-// Класс-обёртка для доступа (только чтение) к shared memory
+inline ShmDemandSize ShmDemand(const SharedHeader* mem, ULONGLONG now = ::GetTickCount64())
+{
+    ShmDemandSize demand = { 0, 0 };
+    for (const SharedReader& r : mem->readerTable)
+    {
+        if (!ShmReaderActive(r, now))
+            continue;
+        const LONG w = r.width.load(std::memory_order_relaxed);
+        const LONG h = r.height.load(std::memory_order_relaxed);
+        if (w > demand.width)
+            demand.width = w;
+        if (h > demand.height)
+            demand.height = h;
+    }
+    return demand;
+}
+
+// Кадр из слота: копия полей формата и указатель на данные
+struct SharedFrame
+{
+    const BYTE* data;
+    LONG  frameId;
+    DWORD fourcc;
+    int   width;
+    int   height;
+    int   stride;
+    DWORD size;
+};
+
+// Проверяет, что описание кадра согласовано и помещается в слот
+inline bool SharedFrameValid(const SharedFrame& f, DWORD slotSize)
+{
+    if (f.width <= 0 || f.height <= 0 || f.size > slotSize)
+        return false;
+    if (f.fourcc == SHM_FOURCC_MJPG)
+        return f.size > 0;  // содержимое потока здесь не разбираем
+    if (f.stride <= 0)
+        return false;
+    const unsigned long long stride = static_cast<unsigned long long>(f.stride);
+    const unsigned long long h = static_cast<unsigned long long>(f.height);
+    switch (f.fourcc)
+    {
+    case SHM_FOURCC_BGR24:
+        return f.stride >= f.width * 3 && f.size >= stride * h;
+    case SHM_FOURCC_NV12:
+    case SHM_FOURCC_I420:
+        // 4:2:0 — размеры чётные, плоскости цветности вдвое меньше
+        return !(f.width & 1) && !(f.height & 1) && !(f.stride & 1) &&
+               f.stride >= f.width && f.size >= stride * h * 3 / 2;
+    default:
+        return false;
+    }
+}
+
+// Результат чтения кадра под seqlock
+enum class FrameRead
+{
+    Ok,      // кадр прочитан целиком
+    Torn,    // писатель перезаписывал буфер на каждой попытке — кадр может быть смешанным
+    NoFrame  // в памяти ещё нет кадра
+};
+
+// Класс-обёртка для доступа к shared memory. Кадры только читаются; запись
+// нужна лишь для счётчиков читателей. Если открыть на запись не дали,
+// работаем только на чтение и полагаемся на seqlock.
+//
+// Подключение идёт в отдельном потоке: пока писатель не запущен, поток
+// пробует открыть секцию с нарастающей паузой, а затем публикует указатель
+// атомарно. Поток кадров и перечисление устройств никогда не ждут.
 class SharedMem
 {
     HANDLE hMap  = nullptr;
-    SharedHeader* pMem = nullptr;
-    int openAttempts = 0;
+    std::atomic<HANDLE> hFrameEvent{ nullptr }; // своё событие кадра, появляется вместе с записью читателя
+    HANDLE hConnectThread = nullptr;
+    HANDLE hStopConnect = nullptr;
+    std::atomic<SharedHeader*> pMem{ nullptr };
+    // Заполняются до публикации pMem и дальше не меняются
+    size_t mappedBytes = 0;     // размер отображения; слоты должны в него помещаться
+    bool writable = false;
+    bool largePages = false;    // вид отображён на больших страницах
+    // Своя запись в таблице читателей, -1 — ещё не занята. Занимает её поток
+    // кадров, читает ещё и поток приёмника, отпускающий семплы (Unpin).
+    std::atomic<int> readerIndex{ -1 };
+    // Запущен ли граф пина и о чём он договорился с приёмником; переносятся
+    // в запись, как только она появится
+    std::atomic<bool> streaming{ false };
+    std::atomic<DWORD> demandFourCC{ 0 };
+    std::atomic<LONG> demandWidth{ 0 };
+    std::atomic<LONG> demandHeight{ 0 };
+
+    // Одна попытка открыть и отобразить секцию, без ожидания
+    bool TryOpen()
+    {
+        bool canWrite = true;
+        HANDLE map = ::OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, VCAM_SHM_NAME);
+        if (!map)
+        {
+            canWrite = false;
+            map = ::OpenFileMappingW(FILE_MAP_READ, FALSE, VCAM_SHM_NAME);
+        }
+        if (!map) return false;
+
+        // Размер секции задаёт писатель — отображаем её целиком. Если писатель
+        // создал секцию на больших страницах, вид тоже просим на них: кадр
+        // занимает три страницы TLB вместо полутора тысяч. Для обычной секции
+        // такой вызов не проходит — тогда отображаем как обычно.
+        const DWORD access = canWrite ? (FILE_MAP_READ | FILE_MAP_WRITE) : FILE_MAP_READ;
+        bool large = true;
+        SharedHeader* mem = reinterpret_cast<SharedHeader*>(::MapViewOfFile(map, access | FILE_MAP_LARGE_PAGES, 0, 0, 0));
+        if (!mem)
+        {
+            large = false;
+            mem = reinterpret_cast<SharedHeader*>(::MapViewOfFile(map, access, 0, 0, 0));
+        }
+        if (!mem)
+        {
+            ::CloseHandle(map);
+            return false;
+        }
+
+        MEMORY_BASIC_INFORMATION mbi = {};
+        ::VirtualQuery(mem, &mbi, sizeof(mbi));
+        mappedBytes = mbi.RegionSize;
+        writable = canWrite;
+        largePages = large;
+        hMap = map;
+        pMem.store(mem, std::memory_order_release);
+        return true;
+    }
+
+    // Копирует описание кадра из слота. Вызывать под seqlock; согласованность
+    // полей проверяет SharedFrameValid.
+    static SharedFrame LoadFrame(const SharedHeader* mem, DWORD slot)
+    {
+        const SharedSlot& s = mem->slots[slot];
+        SharedFrame f;
+        f.data    = mem->Data(slot);
+        f.frameId = s.frameId.load(std::memory_order_acquire);
+        f.fourcc  = s.fourcc.load(std::memory_order_relaxed);
+        f.width   = s.width.load(std::memory_order_relaxed);
+        f.height  = s.height.load(std::memory_order_relaxed);
+        f.stride  = s.stride.load(std::memory_order_relaxed);
+        f.size    = s.size.load(std::memory_order_relaxed);
+        return f;
+    }
+
+    SharedReader* OwnReader(SharedHeader* mem) const
+    {
+        const int idx = readerIndex.load(std::memory_order_acquire);
+        return idx >= 0 ? &mem->readerTable[idx] : nullptr;
+    }
+
+    // Занимает свободную запись в таблице читателей. -1 — таблица полна.
+    int ClaimReader(SharedHeader* mem)
+    {
+        const DWORD pid = ::GetCurrentProcessId();
+        for (DWORD i = 0; i < SHM_MAX_READERS; ++i)
+        {
+            SharedReader& r = mem->readerTable[i];
+            if (r.pid.load(std::memory_order_relaxed) != 0)
+                continue;
+
+            // Писатель откроет событие по pid и номеру записи. Оно создаётся
+            // до того, как запись станет занятой: увидев pid, писатель
+            // открывает событие сразу, а неудачу не повторяет до смены
+            // записи. Если создать не вышло, WaitForNewFrame опрашивает frameId.
+            wchar_t name[64];
+            swprintf_s(name, _countof(name), VCAM_EVENT_FORMAT, static_cast<unsigned long>(pid), static_cast<int>(i));
+            const HANDLE ev = ::CreateEventW(nullptr, FALSE, FALSE, name);
+
+            DWORD expected = 0;
+            if (!r.pid.compare_exchange_strong(expected, pid, std::memory_order_acq_rel))
+            {
+                if (ev)
+                    ::CloseHandle(ev);
+                continue;
+            }
+            // Запись освобождают только без закреплённых слотов, счётчики
+            // в ней уже нулевые
+            r.lastFrameId.store(0, std::memory_order_relaxed);
+            r.fourcc.store(0, std::memory_order_relaxed);
+            r.width.store(0, std::memory_order_relaxed);
+            r.height.store(0, std::memory_order_relaxed);
+            r.streaming.store(0, std::memory_order_relaxed);
+            r.heartbeat.store(0, std::memory_order_release);
+            hFrameEvent.store(ev, std::memory_order_release);
+
+            readerIndex.store(static_cast<int>(i), std::memory_order_release);
+            return static_cast<int>(i);
+        }
+        return -1;
+    }
+
+    // Отпускает свою запись. Если слоты всё ещё закреплены, запись остаётся
+    // занятой: писатель вернёт их сам, когда процесс завершится.
+    void ReleaseReader(SharedHeader* mem)
+    {
+        const int idx = readerIndex.exchange(-1);
+        if (idx < 0)
+            return;
+        SharedReader& r = mem->readerTable[idx];
+        for (const auto& pins : r.pins)
+        {
+            if (pins.load(std::memory_order_relaxed) != 0)
+                return;
+        }
+        r.streaming.store(0, std::memory_order_relaxed);
+        r.heartbeat.store(0, std::memory_order_relaxed);
+        r.pid.store(0, std::memory_order_release);
+    }
+
+    // Своя запись таблицы читателей; при первом вызове занимает её. nullptr —
+    // секции ещё нет, она открыта только на чтение или таблица полна.
+    SharedReader* AcquireReader()
+    {
+        SharedHeader* mem = pMem.load(std::memory_order_acquire);
+        if (!writable || !SlotCount())
+            return nullptr;
+        if (SharedReader* r = OwnReader(mem))
+            return r;
+        const int idx = ClaimReader(mem);
+        return idx >= 0 ? &mem->readerTable[idx] : nullptr;
+    }
+
+    void StoreDemand(SharedReader& r) const
+    {
+        r.fourcc.store(demandFourCC.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        r.width.store(demandWidth.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        r.height.store(demandHeight.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    static DWORD WINAPI ConnectThreadProc(LPVOID param)
+    {
+        SharedMem* self = static_cast<SharedMem*>(param);
+        DWORD backoffMs = 50;
+        while (!self->TryOpen())
+        {
+            if (::WaitForSingleObject(self->hStopConnect, backoffMs) == WAIT_OBJECT_0)
+                return 0;
+            if (backoffMs < 1000)
+                backoffMs *= 2;
+        }
+        return 0;
+    }
 
 public:
-    bool Open()
+    SharedMem() = default;
+    SharedMem(const SharedMem&) = delete;
+    SharedMem& operator=(const SharedMem&) = delete;
+
+    // Запускает фоновое подключение и сразу возвращается. true — секция уже
+    // открыта (первая попытка делается синхронно, она не ждёт).
+    bool Connect()
+    {
+        if (Get() || hConnectThread) return Get() != nullptr;
+        if (TryOpen()) return true;
+
+        hStopConnect = ::CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (hStopConnect)
+            hConnectThread = ::CreateThread(nullptr, 0, ConnectThreadProc, this, 0, nullptr);
+        return false;
+    }
+
+    const SharedHeader* Get() const { return pMem.load(std::memory_order_acquire); }
+    bool IsWritable() const { return Get() && writable; }
+    bool UsesLargePages() const { return Get() && largePages; }
+
+    // Число слотов, если заголовок совместим с фильтром, иначе 0
+    DWORD SlotCount() const
+    {
+        const SharedHeader* mem = Get();
+        if (!mem || mem->version.load(std::memory_order_acquire) != SHM_VERSION ||
+            mem->magic.load(std::memory_order_relaxed) != SHM_MAGIC)
+            return 0;
+        const DWORD count = mem->slotCount.load(std::memory_order_acquire);
+        if (count < SHM_MIN_SLOTS || count > SHM_MAX_SLOTS)
+            return 0;
+        // Слоты выровнены на страницу и целиком лежат внутри отображения
+        const size_t slotSize = mem->slotSize.load(std::memory_order_acquire);
+        const size_t dataOffset = mem->dataOffset.load(std::memory_order_acquire);
+        if (!slotSize || (slotSize % SHM_PAGE) || (dataOffset % SHM_PAGE) ||
+            dataOffset < sizeof(SharedHeader) || dataOffset + count * slotSize > mappedBytes)
+            return 0;
+        return count;
+    }
+
+    // Ждёт, пока писатель опубликует кадр новее lastId, но не дольше timeoutMs.
+    // Возвращает true, если новый кадр есть. Пока своего события нет (запись
+    // в таблице читателей ещё не занята или память открыта только на
+    // чтение), опрашивает frameId с шагом 5 мс.
+    bool WaitForNewFrame(LONG lastId, DWORD timeoutMs)
+    {
+        const ULONGLONG deadline = ::GetTickCount64() + timeoutMs;
+        for (;;)
+        {
+            const SharedHeader* mem = Get();
+            if (mem && mem->frameId.load(std::memory_order_acquire) != lastId)
+                return true;
+
+            const ULONGLONG now = ::GetTickCount64();
+            if (now >= deadline)
+                return false;
+            const DWORD remaining = static_cast<DWORD>(deadline - now);
+
+            if (HANDLE ev = hFrameEvent.load(std::memory_order_acquire))
+            {
+                // Событие могло остаться взведённым от уже прочитанного кадра —
+                // поэтому после пробуждения frameId проверяется заново
+                ::WaitForSingleObject(ev, remaining);
+            }
+            else
+            {
+                ::Sleep(remaining < 5 ? remaining : 5);
+            }
+        }
+    }
+
+    // Передаёт в read (const SharedFrame&) последний опубликованный кадр и
+    // проверяет, что писатель не трогал слот, пока read с ним работал. На
+    // время чтения слот помечается счётчиком читателей, и писатель выбирает
+    // другой. Писатель при этом никогда не ждёт читателя. Кадр с
+    // несогласованным описанием в read не передаётся.
+    template <class ReadFn>
+    FrameRead ReadFrame(ReadFn&& read) const
+    {
+        const DWORD count = SlotCount();
+        SharedHeader* mem = pMem.load(std::memory_order_acquire);
+        if (!count)
+            return FrameRead::NoFrame;
+        const DWORD slotSize = mem->slotSize.load(std::memory_order_acquire);
+
+        bool anyRead = false;
+        constexpr int kAttempts = 3;
+        for (int attempt = 0; attempt < kAttempts; ++attempt)
+        {
+            const DWORD slot = static_cast<DWORD>(mem->currentBuffer.load(std::memory_order_seq_cst));
+            if (slot >= count)
+                return FrameRead::NoFrame;
+            SharedSlot& s = mem->slots[slot];
+
+            // Схема Деккера: читатель увеличивает readers и затем смотрит seq,
+            // писатель делает seq нечётным и затем смотрит readers. Хотя бы
+            // одна сторона увидит другую, оба шага — seq_cst.
+            SharedReader* reader = writable ? OwnReader(mem) : nullptr;
+            if (writable)
+                s.readers.fetch_add(1, std::memory_order_seq_cst);
+            if (reader)
+                reader->pins[slot].fetch_add(1, std::memory_order_relaxed);
+
+            bool ok = false;
+            const LONG seq = s.seq.load(std::memory_order_seq_cst);
+            bool invalid = false;
+            if (!(seq & 1))
+            {
+                const SharedFrame frame = LoadFrame(mem, slot);
+                invalid = !SharedFrameValid(frame, slotSize);
+                if (!invalid)
+                {
+                    read(frame);
+                    anyRead = true;
+                }
+
+                // Чтение данных не должно переехать за повторную проверку счётчика
+                std::atomic_thread_fence(std::memory_order_acquire);
+                ok = s.seq.load(std::memory_order_relaxed) == seq;
+            }
+
+            if (reader)
+                reader->pins[slot].fetch_sub(1, std::memory_order_relaxed);
+            if (writable)
+                s.readers.fetch_sub(1, std::memory_order_release);
+            if (ok)
+                return invalid ? FrameRead::NoFrame : FrameRead::Ok;
+        }
+        // Если read ни разу не вызывался, в выходном буфере ничего нет
+        return anyRead ? FrameRead::Torn : FrameRead::NoFrame;
+    }
+
+    // Закрепляет слот последнего опубликованного кадра: пока слот закреплён,
+    // писатель выбирает другой, и данные можно отдавать без копирования.
+    // Возвращает номер слота (снять — Unpin) или -1, если кадра нет, слот
+    // сейчас пишется или память открыта только на чтение.
+    int PinLatest(SharedFrame* frame)
     {
-        if (hMap) return true;
-        
-        // Пытаемся несколько раз, с небольшими задержками
-        for (int i = 0; i < 3; i++)
+        const DWORD count = SlotCount();
+        SharedHeader* mem = pMem.load(std::memory_order_acquire);
+        if (!count || !writable)
+            return -1;
+        const DWORD slotSize = mem->slotSize.load(std::memory_order_acquire);
+
+        constexpr int kAttempts = 3;
+        for (int attempt = 0; attempt < kAttempts; ++attempt)
         {
-            hMap = ::OpenFileMappingW(FILE_MAP_READ, FALSE, L"Global\\vCamShm");
-            if (hMap) break;
-            ::Sleep(100); // Ждем 100 мс перед следующей попыткой
+            const DWORD slot = static_cast<DWORD>(mem->currentBuffer.load(std::memory_order_seq_cst));
+            if (slot >= count)
+                return -1;
+            SharedSlot& s = mem->slots[slot];
+
+            // Та же схема Деккера, что в ReadFrame, но счётчик читателей
+            // остаётся увеличенным до Unpin
+            SharedReader* reader = OwnReader(mem);
+            s.readers.fetch_add(1, std::memory_order_seq_cst);
+            if (reader)
+                reader->pins[slot].fetch_add(1, std::memory_order_relaxed);
+            if (!(s.seq.load(std::memory_order_seq_cst) & 1))
+            {
+                // Пока слот закреплён, писатель его не меняет — описание
+                // можно читать без повторной проверки seq
+                *frame = LoadFrame(mem, slot);
+                if (SharedFrameValid(*frame, slotSize))
+                    return static_cast<int>(slot);
+            }
+            if (reader)
+                reader->pins[slot].fetch_sub(1, std::memory_order_relaxed);
+            s.readers.fetch_sub(1, std::memory_order_release);
         }
-        
-        openAttempts++;
-        
-        if (!hMap) return false;
-        pMem = reinterpret_cast<SharedHeader*>(::MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, sizeof(SharedHeader)));
-        return pMem != nullptr;
+        return -1;
     }
 
-    const SharedHeader* Get() const { return pMem; }
+    void Unpin(int slot)
+    {
+        if (SharedHeader* mem = pMem.load(std::memory_order_acquire))
+        {
+            if (SharedReader* reader = OwnReader(mem))
+                reader->pins[slot].fetch_sub(1, std::memory_order_relaxed);
+            mem->slots[slot].readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    // Отмечает в таблице читателей, какой кадр пин отдал последним, и
+    // обновляет heartbeat. Запись занимается при первом вызове; если память
+    // открыта только на чтение или таблица полна, пин работает как раньше,
+    // писатель его просто не видит.
+    void UpdateReader(LONG lastFrameId)
+    {
+        SharedReader* r = AcquireReader();
+        if (!r)
+            return;
+        StoreDemand(*r);
+        r->streaming.store(streaming.load(std::memory_order_relaxed) ? 1 : 0, std::memory_order_relaxed);
+        r->lastFrameId.store(lastFrameId, std::memory_order_relaxed);
+        r->heartbeat.store(::GetTickCount64(), std::memory_order_release);
+    }
+
+    // Формат, о котором пин договорился с приёмником. По нему писатель
+    // выбирает размер публикуемых кадров. Запись читателя ради этого не
+    // занимается: приложения перебирают форматы и у неподключённых пинов,
+    // а спрос учитывается только у запущенных.
+    void SetDemand(DWORD fourcc, int width, int height)
+    {
+        demandFourCC.store(fourcc, std::memory_order_relaxed);
+        demandWidth.store(width, std::memory_order_relaxed);
+        demandHeight.store(height, std::memory_order_relaxed);
+        if (SharedHeader* mem = pMem.load(std::memory_order_acquire))
+        {
+            if (SharedReader* r = OwnReader(mem))
+                StoreDemand(*r);
+        }
+    }
+
+    // Граф пина запущен (on) или остановлен. По флагу писатель решает,
+    // публиковать ли кадры вообще, поэтому он выставляется сразу, не
+    // дожидаясь кадра. Если секции ещё нет, флаг попадёт в запись с первым
+    // UpdateReader.
+    void SetStreaming(bool on)
+    {
+        streaming.store(on, std::memory_order_relaxed);
+        if (SharedReader* r = AcquireReader())
+        {
+            StoreDemand(*r);
+            r->streaming.store(on ? 1 : 0, std::memory_order_relaxed);
+            r->heartbeat.store(::GetTickCount64(), std::memory_order_release);
+        }
+    }
 
     ~SharedMem()
     {
-        if (pMem) ::UnmapViewOfFile(pMem);
+        if (hConnectThread)
+        {
+            ::SetEvent(hStopConnect);
+            ::WaitForSingleObject(hConnectThread, INFINITE);
+            ::CloseHandle(hConnectThread);
+        }
+        if (hStopConnect) ::CloseHandle(hStopConnect);
+        if (SharedHeader* mem = pMem.load())
+        {
+            ReleaseReader(mem);
+            ::UnmapViewOfFile(mem);
+        }
         if (hMap) ::CloseHandle(hMap);
+        if (HANDLE ev = hFrameEvent.exchange(nullptr)) ::CloseHandle(ev);
     }
-}; 
\ No newline at end of file
+};
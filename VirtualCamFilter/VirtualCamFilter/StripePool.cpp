@@ -0,0 +1,139 @@
+#include "pch.h"
+#include "StripePool.h"
+#include <stdlib.h>
+
+namespace {
+
+// Меньше этого число строк в полосе не делаем: на маленьких кадрах
+// пробуждение потоков дороже самой конвертации
+constexpr int kMinStripeRows = 32;
+
+int ClampThreads(int n)
+{
+    if (n < 1) return 1;
+    return n > StripePool::kMaxThreads ? StripePool::kMaxThreads : n;
+}
+
+} // namespace
+
+int StripePoolThreadsSetting()
+{
+    char value[16] = {};
+    DWORD n = GetEnvironmentVariableA("VCAM_THREADS", value, sizeof(value));
+    if (n > 0 && n < sizeof(value))
+    {
+        const int threads = atoi(value);
+        if (threads > 0)
+            return ClampThreads(threads);
+    }
+
+    DWORD threads = 0;
+    DWORD cb = sizeof(threads);
+    if (RegGetValueA(HKEY_CURRENT_USER, "Software\\VirtualCamFilter", "Threads",
+                     RRF_RT_REG_DWORD, nullptr, &threads, &cb) == ERROR_SUCCESS && threads > 0)
+        return ClampThreads(static_cast<int>(threads));
+
+    SYSTEM_INFO si = {};
+    GetSystemInfo(&si);
+    return ClampThreads(static_cast<int>(si.dwNumberOfProcessors));
+}
+
+bool StripePool::Start(int threads)
+{
+    Stop();
+    if (threads <= 0)
+        threads = StripePoolThreadsSetting();
+    threads = ClampThreads(threads);
+    if (threads == 1)
+        return true;
+
+    m_done = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    if (!m_done)
+        return false;
+
+    m_stop.store(false, std::memory_order_relaxed);
+    for (int i = 0; i < threads - 1; ++i)
+    {
+        Worker& w = m_workers[m_workerCount];
+        w.pool   = this;
+        w.stripe = i + 1;   // полоса 0 — вызывающего потока
+        w.start  = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        w.thread = w.start ? CreateThread(nullptr, 0, WorkerProc, &w, 0, nullptr) : nullptr;
+        if (!w.thread)
+        {
+            if (w.start) CloseHandle(w.start);
+            w.start = nullptr;
+            break;  // работаем с теми потоками, что успели создать
+        }
+        ++m_workerCount;
+    }
+    return m_workerCount > 0;
+}
+
+void StripePool::Stop()
+{
+    m_stop.store(true, std::memory_order_relaxed);
+    for (int i = 0; i < m_workerCount; ++i)
+    {
+        Worker& w = m_workers[i];
+        SetEvent(w.start);
+        WaitForSingleObject(w.thread, INFINITE);
+        CloseHandle(w.thread);
+        CloseHandle(w.start);
+        w = Worker();
+    }
+    m_workerCount = 0;
+    if (m_done)
+    {
+        CloseHandle(m_done);
+        m_done = nullptr;
+    }
+}
+
+void StripePool::Run(ConvertFn fn, const ConvertArgs& a)
+{
+    int stripes = a.height / kMinStripeRows;
+    if (stripes > Threads()) stripes = Threads();
+    if (stripes <= 1)
+    {
+        fn(a);
+        return;
+    }
+
+    m_fn      = fn;
+    m_args    = a;
+    m_stripes = stripes;
+    m_pending.store(stripes - 1, std::memory_order_relaxed);
+    for (int i = 0; i < stripes - 1; ++i)
+        SetEvent(m_workers[i].start);
+
+    RunStripe(0);
+    WaitForSingleObject(m_done, INFINITE);
+}
+
+void StripePool::RunStripe(int stripe)
+{
+    // Высота полосы округляется вверх до чётной
+    const int rows = ((m_args.height + m_stripes - 1) / m_stripes + 1) & ~1;
+    ConvertArgs a = m_args;
+    a.rowBegin = stripe * rows;
+    a.rowEnd   = a.rowBegin + rows < a.height ? a.rowBegin + rows : a.height;
+    if (a.rowBegin < a.height)
+        m_fn(a);
+}
+
+DWORD WINAPI StripePool::WorkerProc(LPVOID param)
+{
+    Worker& w = *static_cast<Worker*>(param);
+    StripePool& pool = *w.pool;
+    for (;;)
+    {
+        WaitForSingleObject(w.start, INFINITE);
+        if (pool.m_stop.load(std::memory_order_relaxed))
+            return 0;
+
+        pool.RunStripe(w.stripe);
+        if (pool.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            SetEvent(pool.m_done);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include "PixelConvert.h"
+
+// ----------------------------------------------------------------------------
+// Пул потоков для конвертации кадра полосами строк. Живёт вместе с потоком
+// выдачи кадров пина: создаётся в OnThreadCreate, останавливается в
+// OnThreadDestroy. Одну полосу считает вызывающий поток, остальные —
+// рабочие; Run возвращается, когда готовы все полосы.
+//
+// Число потоков: переменная окружения VCAM_THREADS или DWORD Threads в
+// HKCU\Software\VirtualCamFilter. 0 или отсутствие — по числу ядер (не
+// больше kMaxThreads), 1 — без пула, всё в вызывающем потоке.
+// ----------------------------------------------------------------------------
+class StripePool
+{
+public:
+    static constexpr int kMaxThreads = 8;
+
+    StripePool() = default;
+    StripePool(const StripePool&) = delete;
+    StripePool& operator=(const StripePool&) = delete;
+    ~StripePool() { Stop(); }
+
+    // threads — общее число полос, включая вызывающий поток; 0 — из настроек
+    bool Start(int threads = 0);
+    void Stop();
+
+    // Сколько полос считается параллельно (1, если пул не запущен)
+    int Threads() const { return m_workerCount + 1; }
+
+    // Конвертирует кадр a функцией fn, разбив выходные строки на полосы.
+    // Границы полос чётные, чтобы пара строк 4:2:0 не разрывалась.
+    void Run(ConvertFn fn, const ConvertArgs& a);
+
+private:
+    struct Worker
+    {
+        StripePool* pool   = nullptr;
+        int         stripe = 0;
+        HANDLE      thread = nullptr;
+        HANDLE      start  = nullptr;   // авто-сброс: есть задание
+    };
+
+    static DWORD WINAPI WorkerProc(LPVOID param);
+    void RunStripe(int stripe);
+
+    Worker            m_workers[kMaxThreads - 1];
+    int               m_workerCount = 0;
+    HANDLE            m_done = nullptr; // авто-сброс: последняя полоса готова
+    std::atomic<LONG> m_pending{ 0 };
+    std::atomic<bool> m_stop{ false };
+
+    // Текущее задание. Пишется до SetEvent(start) и читается после
+    // пробуждения — событие служит барьером.
+    ConvertFn   m_fn = nullptr;
+    ConvertArgs m_args = {};
+    int         m_stripes = 1;
+};
+
+// Число потоков из настроек (см. выше), уже ограниченное 1..kMaxThreads
+int StripePoolThreadsSetting();
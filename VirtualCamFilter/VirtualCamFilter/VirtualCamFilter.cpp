@@ -1,6 +1,9 @@
 #include "pch.h"
 #include "VirtualCamGuids.h"
 #include "SharedMem.h"
+#include "PixelConvert.h"
+#include "StripePool.h"
+#include "Log.h"
 #include <objbase.h>
 #include <streams.h>
 #include <ks.h>        // должно быть перед ksmedia.h, но после streams.h чтобы не перебивать константы в reftime.h
@@ -8,48 +11,12 @@
 #include <dvdmedia.h>
 #include <stdio.h>
 #include <atomic>
+#include <vector>
 
 // Если в заголовках нет MEDIASUBTYPE_I420, определяем здесь
 #ifndef MEDIASUBTYPE_I420
 static const GUID MEDIASUBTYPE_I420 = { 0x30323449, 0x0000, 0x0010,{0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71} }; // 'I420'
 #endif
-// ----------------------------
-// Запись лога в файл (append)
-// ----------------------------
-#include <mutex>
-
-static HANDLE GetLogHandle()
-{
-    static HANDLE hLog = INVALID_HANDLE_VALUE;
-    if (hLog != INVALID_HANDLE_VALUE)
-        return hLog;
-
-    const char* const fixedDir = "C:\\cwl\\VirtualCamFilter\\";
-    char path[MAX_PATH] = {};
-    strcpy_s(path, fixedDir);
-    strcat_s(path, "vCamLog.txt");
-
-    // Создаём каталог, если его нет
-    CreateDirectoryA(fixedDir, NULL);
-
-    hLog = CreateFileA(path, FILE_APPEND_DATA, FILE_SHARE_READ, NULL,
-                       OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
-    if (hLog != INVALID_HANDLE_VALUE)
-    {
-        // Перемещаемся в конец
-        SetFilePointer(hLog, 0, NULL, FILE_END);
-    }
-    return hLog;
-}
-
-static void WriteLogFile(const char* text)
-{
-    HANDLE h = GetLogHandle();
-    if (h == INVALID_HANDLE_VALUE) return;
-    DWORD len = (DWORD)strlen(text);
-    DWORD written;
-    WriteFile(h, text, len, &written, NULL);
-}
 // ----------------------------------------------------------------------------
 // Утилиты для отладочного логирования
 // ----------------------------------------------------------------------------
@@ -59,42 +26,147 @@ static const char* GuidName(const GUID& g)
     if (g == MEDIASUBTYPE_RGB24) return "RGB24";
     if (g == MEDIASUBTYPE_NV12)  return "NV12";
     if (g == MEDIASUBTYPE_I420)  return "I420";
-#ifdef MEDIASUBTYPE_MJPG
     if (g == MEDIASUBTYPE_MJPG)  return "MJPG";
-#endif
     return "UNKNOWN";
 }
 
+// BITMAPINFOHEADER формата: у VIDEOINFOHEADER2 он лежит по другому смещению.
+// Прочие типы формата разбираем как VIDEOINFOHEADER, как и раньше.
+static BITMAPINFOHEADER* GetBmiHeader(const AM_MEDIA_TYPE* pmt)
+{
+    if (!pmt || !pmt->pbFormat) return nullptr;
+    if (pmt->formattype == FORMAT_VideoInfo2)
+    {
+        if (pmt->cbFormat < sizeof(VIDEOINFOHEADER2)) return nullptr;
+        return &reinterpret_cast<VIDEOINFOHEADER2*>(pmt->pbFormat)->bmiHeader;
+    }
+    return &reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat)->bmiHeader;
+}
+
+static REFERENCE_TIME GetAvgTimePerFrame(const AM_MEDIA_TYPE* pmt)
+{
+    if (pmt->formattype == FORMAT_VideoInfo2)
+        return reinterpret_cast<const VIDEOINFOHEADER2*>(pmt->pbFormat)->AvgTimePerFrame;
+    return reinterpret_cast<const VIDEOINFOHEADER*>(pmt->pbFormat)->AvgTimePerFrame;
+}
+
+static void LogMediaType(int level, const char* where, const AM_MEDIA_TYPE* pmt)
+{
+    if (level > VCAM_LOG_LEVEL || !pmt) return;
+    const BITMAPINFOHEADER* bmi = GetBmiHeader(pmt);
+    if (!bmi) return;
+
+    const REFERENCE_TIME avg = GetAvgTimePerFrame(pmt);
+    double fps = avg ? 1e7 / static_cast<double>(avg) : 0.0;
+    LogWrite(level, "vCam %s: subtype=%s, %dx%d%s, fps=%.2f%s\n",
+             where,
+             GuidName(pmt->subtype),
+             bmi->biWidth,
+             abs(bmi->biHeight),
+             (bmi->biHeight < 0 ? " top-down" : ""),
+             fps,
+             (pmt->formattype == FORMAT_VideoInfo2 ? ", VIH2" : ""));
+}
+
 static void LogMediaType(const char* where, const AM_MEDIA_TYPE* pmt)
 {
-    if (!pmt) return;
-    const VIDEOINFOHEADER* vih = reinterpret_cast<const VIDEOINFOHEADER*>(pmt->pbFormat);
-    if (!vih) return;
-
-    char buf[256] = {};
-    double fps = vih->AvgTimePerFrame ? 1e7 / static_cast<double>(vih->AvgTimePerFrame) : 0.0;
-    sprintf_s(buf, "vCam %s: subtype=%s, %dx%d%s, fps=%.2f\n",
-              where,
-              GuidName(pmt->subtype),
-              vih->bmiHeader.biWidth,
-              abs(vih->bmiHeader.biHeight),
-              (vih->bmiHeader.biHeight < 0 ? " top-down" : ""),
-              fps);
-    OutputDebugStringA(buf);
-    WriteLogFile(buf);
+    LogMediaType(VCAM_LOG_LEVEL_INFO, where, pmt);
 }
 
 static void LogMediaType(const char* where, const CMediaType* pmt)
 {
     LogMediaType(where, static_cast<const AM_MEDIA_TYPE*>(pmt));
 }
+
+// ----------------------------------------------------------------------------
+// Цветовое пространство YUV. В VIDEOINFOHEADER2 оно передаётся в
+// dwControlFlags: при AMCONTROL_COLORINFO_PRESENT старшие 24 бита — поля
+// DXVA_ExtendedFormat (биты 12-14 — NominalRange, 15-17 — VideoTransferMatrix).
+// ----------------------------------------------------------------------------
+static const DWORD kNominalRangeShift   = 12;
+static const DWORD kTransferMatrixShift = 15;
+static const DWORD kNominalRange0_255   = 1;   // DXVA_NominalRange_0_255
+static const DWORD kNominalRange16_235  = 2;   // DXVA_NominalRange_16_235
+static const DWORD kTransferMatrixBT709 = 1;   // DXVA_VideoTransferMatrix_BT709
+static const DWORD kTransferMatrixBT601 = 2;   // DXVA_VideoTransferMatrix_BT601
+
+static bool IsBT709(ColorSpace cs) { return cs == ColorSpace::BT709Limited || cs == ColorSpace::BT709Full; }
+static bool IsFullRange(ColorSpace cs) { return cs == ColorSpace::BT601Full || cs == ColorSpace::BT709Full; }
+
+static ColorSpace MakeColorSpace(bool bt709, bool fullRange)
+{
+    if (fullRange)
+        return bt709 ? ColorSpace::BT709Full : ColorSpace::BT601Full;
+    return bt709 ? ColorSpace::BT709Limited : ColorSpace::BT601Limited;
+}
+
+// Тип без сведений о цвете трактуется по обычному соглашению:
+// от 720 строк — BT.709, меньше — BT.601, диапазон 16..235
+static ColorSpace DefaultColorSpace(int height)
+{
+    return MakeColorSpace(height >= 720, false);
+}
+
+// YUV-кадры писателя (NV12/I420) — декодированный JPEG телефона: матрица
+// BT.601 и полный диапазон, как в JFIF. Писатель его не передаёт.
+static const ColorSpace kWriterYuvColorSpace = ColorSpace::BT601Full;
+
+// Цветовое пространство, запрошенное типом. Поля, которые не указаны или
+// нам не известны (SMPTE 240M, 48..208), берутся из умолчания для размера.
+static ColorSpace ColorSpaceFromMediaType(const AM_MEDIA_TYPE* pmt, int height)
+{
+    const ColorSpace def = DefaultColorSpace(height);
+    if (pmt->formattype != FORMAT_VideoInfo2 || pmt->cbFormat < sizeof(VIDEOINFOHEADER2))
+        return def;
+    const DWORD flags = reinterpret_cast<const VIDEOINFOHEADER2*>(pmt->pbFormat)->dwControlFlags;
+    if (!(flags & AMCONTROL_COLORINFO_PRESENT))
+        return def;
+
+    bool bt709     = IsBT709(def);
+    bool fullRange = IsFullRange(def);
+    switch ((flags >> kTransferMatrixShift) & 7)
+    {
+    case kTransferMatrixBT709: bt709 = true;  break;
+    case kTransferMatrixBT601: bt709 = false; break;
+    }
+    switch ((flags >> kNominalRangeShift) & 7)
+    {
+    case kNominalRange0_255:  fullRange = true;  break;
+    case kNominalRange16_235: fullRange = false; break;
+    }
+    return MakeColorSpace(bt709, fullRange);
+}
+
+// Переводит тип с VIDEOINFOHEADER на VIDEOINFOHEADER2 и указывает в нём
+// цветовое пространство
+static void ToVideoInfo2(CMediaType* pmt, ColorSpace cs)
+{
+    const VIDEOINFOHEADER vih = *reinterpret_cast<const VIDEOINFOHEADER*>(pmt->Format());
+    VIDEOINFOHEADER2* vih2 = reinterpret_cast<VIDEOINFOHEADER2*>(pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER2)));
+    if (!vih2) return;
+    ZeroMemory(vih2, sizeof(VIDEOINFOHEADER2));
+
+    vih2->rcSource           = vih.rcSource;
+    vih2->rcTarget           = vih.rcTarget;
+    vih2->dwBitRate          = vih.dwBitRate;
+    vih2->dwBitErrorRate     = vih.dwBitErrorRate;
+    vih2->AvgTimePerFrame    = vih.AvgTimePerFrame;
+    vih2->dwPictAspectRatioX = vih.bmiHeader.biWidth;   // квадратные пиксели
+    vih2->dwPictAspectRatioY = abs(vih.bmiHeader.biHeight);
+    vih2->dwControlFlags     = AMCONTROL_USED | AMCONTROL_COLORINFO_PRESENT |
+                               ((IsFullRange(cs) ? kNominalRange0_255 : kNominalRange16_235) << kNominalRangeShift) |
+                               ((IsBT709(cs) ? kTransferMatrixBT709 : kTransferMatrixBT601) << kTransferMatrixShift);
+    vih2->bmiHeader          = vih.bmiHeader;
+    pmt->SetFormatType(&FORMAT_VideoInfo2);
+}
 // ---- Описание пина/фильтра для регистрации ----
 const AMOVIESETUP_MEDIATYPE sudPinTypes[] =
 {
     { &MEDIATYPE_Video, &MEDIASUBTYPE_YUY2 },
     { &MEDIATYPE_Video, &MEDIASUBTYPE_NV12 },
     { &MEDIATYPE_Video, &MEDIASUBTYPE_I420 },
-    { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 }
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_RGB24 },
+    { &MEDIATYPE_Video, &MEDIASUBTYPE_MJPG }
 };
 
 const AMOVIESETUP_PIN sudPins[] =
@@ -107,7 +179,7 @@ const AMOVIESETUP_PIN sudPins[] =
         FALSE,           // bMany
         nullptr,         // clsConnectsToFilter
         nullptr,         // strConnectsToPin
-        4,               // nTypes
+        5,               // nTypes
         sudPinTypes      // lpTypes
     }
 };
@@ -121,29 +193,231 @@ const AMOVIESETUP_FILTER sudFilter =
     sudPins                 // lpPin
 };
 
+// ------------------------------------------------------------
+// Аллокатор без копирования. Если кадр писателя уже в выходном формате
+// и размере (строки без выравнивания), семпл указывает прямо в слот shared
+// memory. Слот закреплён счётчиком читателей, пока семпл не вернётся в
+// аллокатор. Во всех остальных случаях у семпла свой буфер.
+// ------------------------------------------------------------
+class CShmSample : public CMediaSample
+{
+    LPBYTE m_ownBuffer;
+    LONG   m_ownLength;
+    int    m_slot = -1;
+
+public:
+    CShmSample(CBaseAllocator* pAlloc, HRESULT* phr, LPBYTE pBuffer, LONG length)
+        : CMediaSample(NAME("vCamShmSample"), pAlloc, phr, pBuffer, length),
+          m_ownBuffer(pBuffer), m_ownLength(length) {}
+
+    void AttachSlot(int slot, const BYTE* data, LONG length)
+    {
+        m_slot = slot;
+        SetPointer(const_cast<BYTE*>(data), length);
+    }
+
+    // Возвращает свой буфер; результат — закреплённый слот или -1
+    int DetachSlot()
+    {
+        const int slot = m_slot;
+        if (slot >= 0)
+        {
+            m_slot = -1;
+            SetPointer(m_ownBuffer, m_ownLength);
+        }
+        return slot;
+    }
+};
+
+class CShmAllocator : public CBaseAllocator
+{
+    SharedMem* m_shm;              // принадлежит пину; пин отключается раньше, чем умирает
+    LPBYTE     m_pBuffer = nullptr;
+
+public:
+    CShmAllocator(SharedMem* shm, HRESULT* phr)
+        : CBaseAllocator(NAME("vCamShmAllocator"), nullptr, phr), m_shm(shm) {}
+
+    ~CShmAllocator() override
+    {
+        Decommit();
+        Free();
+    }
+
+    STDMETHODIMP ReleaseBuffer(IMediaSample* pSample) override
+    {
+        const int slot = static_cast<CShmSample*>(pSample)->DetachSlot();
+        if (slot >= 0)
+            m_shm->Unpin(slot);
+        return CBaseAllocator::ReleaseBuffer(pSample);
+    }
+
+protected:
+    // Как CMemAllocator::Alloc, только семплы — CShmSample
+    HRESULT Alloc() override
+    {
+        CAutoLock lck(this);
+        HRESULT hr = CBaseAllocator::Alloc();
+        if (FAILED(hr))
+            return hr;
+        if (hr == S_FALSE && m_pBuffer)
+            return NOERROR;   // размеры не менялись, буферы уже есть
+        if (m_pBuffer)
+            Free();
+
+        LONG alignedSize = m_lSize + m_lPrefix;
+        if (m_lAlignment > 1 && alignedSize % m_lAlignment)
+            alignedSize += m_lAlignment - alignedSize % m_lAlignment;
+
+        m_pBuffer = static_cast<LPBYTE>(VirtualAlloc(nullptr, static_cast<SIZE_T>(m_lCount) * alignedSize,
+                                                     MEM_COMMIT, PAGE_READWRITE));
+        if (!m_pBuffer)
+            return E_OUTOFMEMORY;
+
+        LPBYTE next = m_pBuffer;
+        for (LONG i = 0; i < m_lCount; ++i, next += alignedSize)
+        {
+            hr = S_OK;
+            CShmSample* sample = new CShmSample(this, &hr, next + m_lPrefix, m_lSize);
+            if (!sample)
+            {
+                Free();
+                return E_OUTOFMEMORY;
+            }
+            if (FAILED(hr))
+            {
+                // Семпл с ошибкой в список не попадает; уже созданные и буфер
+                // освобождаются, аллокатор остаётся пустым, как до Alloc
+                delete sample;
+                Free();
+                return hr;
+            }
+            m_lFree.Add(sample);
+        }
+        m_bChanged = FALSE;
+        m_lAllocated = m_lCount;
+        return NOERROR;
+    }
+
+    void Free() override
+    {
+        while (CMediaSample* sample = m_lFree.RemoveHead())
+            delete sample;
+        m_lAllocated = 0;
+        if (m_pBuffer)
+        {
+            VirtualFree(m_pBuffer, 0, MEM_RELEASE);
+            m_pBuffer = nullptr;
+        }
+    }
+};
+
 // ------------------------------------------------------------
 // Поток, выдающий кадры
 // ------------------------------------------------------------
 class CPushPinVCam : public CSourceStream, public IAMStreamConfig, public IKsPropertySet
 {
     SharedMem m_shm;
+    bool m_shmReported = false;   // подключение к SharedMem уже записано в лог
     LONG      m_lastId = -1;
-    enum Format { NV12, I420, YUY2, RGB24 } m_format = NV12; // текущий формат
+    enum Format { NV12, I420, YUY2, RGB24, MJPG } m_format = NV12; // текущий формат
     int             m_outW  = FRAME_W;         // запрошенная ширина
     int             m_outH  = FRAME_H;         // запрошенная высота
+    ColorSpace      m_colorSpace = ColorSpace::BT709Limited; // матрица и диапазон YUV на выходе
     REFERENCE_TIME  m_rtSampleTime = 0;         // текущее время кадра
+    REFERENCE_TIME  m_rtStreamStart = 0;        // tStart из Run(): нулевое stream time по опорным часам
+    HANDLE          m_hPaceEvent = nullptr;     // событие для IReferenceClock::AdviseTime
+    IReferenceClock* m_clock = nullptr;         // опорные часы графа, взятые в Run(); под m_clockLock
+    CCritSec        m_clockLock;                // не блокировка фильтра: Stop её не ждёт
+    ULONGLONG       m_lateFramesSkipped = 0;
     const REFERENCE_TIME m_rtFrameLength = 333333; // 30 fps (100-нс)
     CMediaType m_mt; // For IAMStreamConfig
+    ConvertFn       m_convert = nullptr;        // ядро m_convertSrc -> m_format (с масштабированием)
+    DWORD           m_convertSrc = SHM_FOURCC_BGR24; // формат кадров писателя, под который привязано ядро
+    StripePool      m_pool;                     // полосы кадра на нескольких ядрах
+    ScaleTables     m_scale;                    // таблицы масштабирования кадр писателя -> выход
+    bool            m_zeroCopy = false;         // семплы от CShmAllocator
+    ULONGLONG       m_zeroCopyFrames = 0;
+
+    // Последний сконвертированный кадр. Если телефон присылает кадры реже,
+    // чем мы их отдаём, повтор того же frameId в том же формате и размере
+    // копируется отсюда, а не конвертируется заново. Кадр кладётся в кэш
+    // только при первом повторе (он конвертируется ещё раз из слота, где
+    // всё ещё опубликован): при кадрах писателя в темпе пина копия на
+    // каждом промахе была бы лишним проходом по кадру.
+    struct ConvertedFrame
+    {
+        std::vector<BYTE> data;
+        LONG   sentId  = -1;   // последний отданный кадр, ещё не положенный в кэш
+        LONG   frameId = -1;
+        Format format  = NV12;
+        ColorSpace colorSpace = ColorSpace::BT601Limited;
+        int    width   = 0;
+        int    height  = 0;
+        bool   valid   = false;
+    } m_cache;
+    ULONGLONG m_cacheHits   = 0;
+    ULONGLONG m_cacheMisses = 0;
+
+    static PixelFormat ToPixelFormat(Format f)
+    {
+        switch (f)
+        {
+        case NV12: return PixelFormat::NV12;
+        case I420: return PixelFormat::I420;
+        case YUY2: return PixelFormat::YUY2;
+        case MJPG: return PixelFormat::Count; // JPEG не конвертируем, только пропускаем
+        default:   return PixelFormat::BGR24; // RGB24 в памяти — это BGR
+        }
+    }
+
+    // Формат кадра писателя; PixelFormat::Count — такого ядра нет
+    static PixelFormat SourcePixelFormat(DWORD fourcc)
+    {
+        switch (fourcc)
+        {
+        case SHM_FOURCC_BGR24: return PixelFormat::BGR24;
+        case SHM_FOURCC_NV12:  return PixelFormat::NV12;
+        case SHM_FOURCC_I420:  return PixelFormat::I420;
+        default:               return PixelFormat::Count;
+        }
+    }
+
+    // Матрица выхода. Для YUV — согласованная с приёмником. У RGB24 своей
+    // матрицы нет, ядро декодирует YUV-кадры писателя по его собственной.
+    ColorSpace OutputColorSpace() const
+    {
+        return m_format == RGB24 ? kWriterYuvColorSpace : m_colorSpace;
+    }
+
+    // Цветовое пространство для VIDEOINFOHEADER2. Пока писатель присылает
+    // YUV, объявляем его собственное — тогда YUV-выход остаётся копированием.
+    // Кадры BGR24 переводим в YUV сами, по обычному соглашению для размера.
+    // Если приёмник выбрал другое, ядро пересчитает отсчёты.
+    ColorSpace OfferedColorSpace(int height) const
+    {
+        DWORD fourcc = 0;
+        const FrameRead read = m_shm.ReadFrame([&](const SharedFrame& frame) { fourcc = frame.fourcc; });
+        if (read == FrameRead::Ok && (fourcc == SHM_FOURCC_NV12 || fourcc == SHM_FOURCC_I420))
+            return kWriterYuvColorSpace;
+        return DefaultColorSpace(height);
+    }
+
+    // Привязываем ядро преобразования к текущей паре форматов.
+    // Реализация (scalar/SSE2/AVX2) выбрана реестром ядер один раз на процесс.
+    void BindConverter()
+    {
+        m_convert = GetConverter(SourcePixelFormat(m_convertSrc), ToPixelFormat(m_format));
+    }
 
 public:
     CPushPinVCam(HRESULT* phr, CSource* pSrc)
         : CSourceStream(NAME("vCamPin"), phr, pSrc, L"Out")
     {
-        // Пытаемся открыть shared memory
-        bool opened = m_shm.Open();
-        char buf[128] = {};
-        sprintf_s(buf, "vCam: Инициализация пина, SharedMem открыта: %s\n", opened ? "да" : "нет");
-        WriteLogFile(buf);
+        // Подключаемся к shared memory в фоне: писатель может запуститься
+        // позже, а конструктор вызывается и при простом перечислении устройств
+        bool opened = m_shm.Connect();
+        VCAM_LOG_INFO("vCam: Инициализация пина, SharedMem открыта: %s\n", opened ? "да" : "нет, ждём в фоне");
 
         // Устанавливаем последний ID в недопустимое значение, 
         // чтобы гарантировать получение первого кадра
@@ -161,7 +435,12 @@ public:
             m_outW = vihDef->bmiHeader.biWidth;
             m_outH = abs(vihDef->bmiHeader.biHeight);
             m_format = YUY2;
+            m_colorSpace = DefaultColorSpace(m_outH);
         }
+        BindConverter();
+
+        VCAM_LOG_INFO("vCam: Ядра преобразования: %s (CPU: %s)\n",
+                      CpuTierName(ActiveCpuTier()), CpuTierName(DetectCpuTier()));
     }
 
     // IUnknown (delegated to CUnknown)
@@ -195,62 +474,65 @@ public:
         const bool isRGB24 = (pmt->subtype == MEDIASUBTYPE_RGB24);
         const bool isNV12  = (pmt->subtype == MEDIASUBTYPE_NV12);
         const bool isI420  = (pmt->subtype == MEDIASUBTYPE_I420);
-        if (!isYUY2 && !isRGB24 && !isNV12 && !isI420)
+        const bool isMJPG  = (pmt->subtype == MEDIASUBTYPE_MJPG);
+        if (!isYUY2 && !isRGB24 && !isNV12 && !isI420 && !isMJPG)
             return E_INVALIDARG;
 
-        // Проверяем корректность структуры VIDEOINFOHEADER
-        VIDEOINFOHEADER* vih = reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat);
-        if (!vih)
+        // Проверяем корректность структуры VIDEOINFOHEADER / VIDEOINFOHEADER2
+        BITMAPINFOHEADER* bmi = GetBmiHeader(pmt);
+        if (!bmi)
             return E_INVALIDARG;
 
-        const int w = vih->bmiHeader.biWidth;
-        const int h = abs(vih->bmiHeader.biHeight);
+        const int w = bmi->biWidth;
+        const int h = abs(bmi->biHeight);
 
-        // Поддерживаемые размеры кадра
+        // Поддерживаемые размеры кадра. JPEG без декодера не масштабируется,
+        // поэтому MJPG — только в размере, который сейчас шлёт писатель
         static const int sizes[][2] = { {1920,1080}, {1280,720}, {960,540}, {640,480} };
         bool validSize = false;
-        for (int i = 0; i < _countof(sizes); ++i)
+        if (isMJPG)
+        {
+            validSize = IsJpegSize(w, h);
+        }
+        else
         {
-            if (w == sizes[i][0] && h == sizes[i][1])
+            for (int i = 0; i < _countof(sizes); ++i)
             {
-                validSize = true;
-                break;
+                if (w == sizes[i][0] && h == sizes[i][1])
+                {
+                    validSize = true;
+                    break;
+                }
             }
         }
         if (!validSize)
             return E_INVALIDARG;
 
-        // Сохраняем формат, но всегда используем FULL HD разрешение
+        // Сохраняем формат и запрошенный размер — кадр масштабируется при выдаче
         if (isNV12) m_format = NV12;
         else if (isI420) m_format = I420;
         else if (isYUY2) m_format = YUY2;
+        else if (isMJPG) m_format = MJPG;
         else m_format = RGB24;
-        
-        // Всегда используем FULL HD разрешение, независимо от запрошенного
-        m_outW = FRAME_W;  // 1920
-        m_outH = FRAME_H;  // 1080
-        
-        // Модифицируем запрошенный формат для установки в m_mt
-        vih->bmiHeader.biWidth = FRAME_W;
-        if (vih->bmiHeader.biHeight < 0)
-            vih->bmiHeader.biHeight = -static_cast<LONG>(FRAME_H);  // используем явное приведение типов
-        else
-            vih->bmiHeader.biHeight = FRAME_H;
-            
+        BindConverter();
+
+        m_outW = w;
+        m_outH = h;
+        m_colorSpace = ColorSpaceFromMediaType(pmt, h);
+
         // Обновляем размер изображения в зависимости от формата
         if (isNV12 || isI420)
-            vih->bmiHeader.biSizeImage = FRAME_W * FRAME_H * 3 / 2;
+            bmi->biSizeImage = w * h * 3 / 2;
         else if (isYUY2)
-            vih->bmiHeader.biSizeImage = FRAME_W * FRAME_H * 2;
+            bmi->biSizeImage = w * h * 2;
         else
-            vih->bmiHeader.biSizeImage = FRAME_W * FRAME_H * 3;
-        
+            bmi->biSizeImage = w * h * 3; // для MJPG — верхняя граница кадра
+
         m_mt.Set(*pmt);
-        
-        char buf[128] = {};
-        sprintf_s(buf, "vCam: Установлено Full HD разрешение: %dx%d вместо запрошенного %dx%d\n", 
-                 FRAME_W, FRAME_H, w, h);
-        WriteLogFile(buf);
+        m_shm.SetDemand(OutputFourCC(), m_outW, m_outH);
+
+        VCAM_LOG_INFO("vCam: Установлено разрешение %dx%d, %s (источник %dx%d)\n",
+                      w, h, ColorSpaceName(m_colorSpace), FRAME_W, FRAME_H);
 
         LogMediaType("SetFormat", pmt);
         return S_OK;
@@ -267,8 +549,11 @@ public:
     STDMETHODIMP GetNumberOfCapabilities(int* piCount, int* piSize) override
     {
         if (!piCount || !piSize) return E_POINTER;
-        *piCount = 16; // 4 размера × 4 формата (NV12 / I420 / YUY2 / RGB24)
-        WriteLogFile("vCam: GetNumberOfCapabilities called\n");
+        // 4 размера × 4 формата (NV12 / I420 / YUY2 / RGB24) + YUV в VIDEOINFOHEADER2,
+        // и MJPG, если писатель сейчас присылает JPEG
+        int jpegW = 0, jpegH = 0;
+        *piCount = 28 + (CurrentJpegSize(&jpegW, &jpegH) ? 1 : 0);
+        VCAM_LOG_DEBUG("vCam: GetNumberOfCapabilities called\n");
         *piSize  = sizeof(VIDEO_STREAM_CONFIG_CAPS);
         return S_OK;
     }
@@ -278,26 +563,32 @@ public:
         static const int sizes[][2] = { {1920,1080}, {1280,720}, {960,540}, {640,480} };
         const int sizeCount = _countof(sizes);
 
-        char bufcap[64];
-        sprintf_s(bufcap, "vCam: GetStreamCaps idx=%d\n", iIndex);
-        WriteLogFile(bufcap);
+        // Приложения перебирают возможности при каждом открытии камеры
+        VCAM_LOG_DEBUG("vCam: GetStreamCaps idx=%d\n", iIndex);
 
         if (!ppmt || !pSCC)
             return E_POINTER;
 
-        // Всего 12 вариантов: 0-3 – YUY2, 4-7 – RGB24, 8-11 – NV12
-        if (iIndex < 0 || iIndex >= sizeCount * 4)
+        // 0-3 – YUY2, 4-7 – NV12, 8-11 – I420, 12-15 – RGB24,
+        // 16-27 – YUY2/NV12/I420 в VIDEOINFOHEADER2 с указанием цветового пространства,
+        // 28 – MJPG в размере JPEG писателя, если он его присылает
+        int jpegW = 0, jpegH = 0;
+        const bool mjpg = iIndex == sizeCount * 7 && CurrentJpegSize(&jpegW, &jpegH);
+        if (iIndex < 0 || (iIndex >= sizeCount * 7 && !mjpg))
             return S_FALSE;
 
-        int idxGroup = iIndex / sizeCount; // 0=YUY2,1=NV12,2=I420,3=RGB24
+        int idxGroup = mjpg ? 4 : iIndex / sizeCount; // 0=YUY2,1=NV12,2=I420,3=RGB24,4=MJPG
+        const bool info2 = !mjpg && idxGroup >= 4;
+        if (info2)
+            idxGroup -= 4;
         const int idx   = iIndex % sizeCount;
         const bool yuy2  = (idxGroup == 0);
         const bool nv12  = (idxGroup == 1);
         const bool i420  = (idxGroup == 2);
         const bool rgb24 = (idxGroup == 3);
 
-        const int w = sizes[idx][0];
-        const int h = sizes[idx][1];
+        const int w = mjpg ? jpegW : sizes[idx][0];
+        const int h = mjpg ? jpegH : sizes[idx][1];
 
         CMediaType tmp;
         VIDEOINFOHEADER vih = {};
@@ -333,6 +624,13 @@ public:
             vih.bmiHeader.biSizeImage   = w * h * 3;
             vih.bmiHeader.biHeight      = h;
         }
+        else if (mjpg)
+        {
+            vih.bmiHeader.biBitCount    = 24;
+            vih.bmiHeader.biCompression = MAKEFOURCC('M','J','P','G');
+            vih.bmiHeader.biSizeImage   = w * h * 3; // верхняя граница, кадры переменной длины
+            vih.bmiHeader.biHeight      = h;
+        }
 
         vih.AvgTimePerFrame         = m_rtFrameLength;
 
@@ -340,18 +638,24 @@ public:
         if (nv12) tmp.SetSubtype(&MEDIASUBTYPE_NV12);
         else if (i420) tmp.SetSubtype(&MEDIASUBTYPE_I420);
         else if (yuy2) tmp.SetSubtype(&MEDIASUBTYPE_YUY2);
+        else if (mjpg) tmp.SetSubtype(&MEDIASUBTYPE_MJPG);
         else tmp.SetSubtype(&MEDIASUBTYPE_RGB24);
         tmp.SetFormatType(&FORMAT_VideoInfo);
         tmp.SetTemporalCompression(FALSE);
-        tmp.SetSampleSize(vih.bmiHeader.biSizeImage);
+        if (mjpg)
+            tmp.SetVariableSize();
+        else
+            tmp.SetSampleSize(vih.bmiHeader.biSizeImage);
         tmp.SetFormat((BYTE*)&vih, sizeof(vih));
+        if (info2)
+            ToVideoInfo2(&tmp, OfferedColorSpace(h));
 
         *ppmt = (AM_MEDIA_TYPE*)CoTaskMemAlloc(sizeof(AM_MEDIA_TYPE));
         if (!*ppmt)
             return E_OUTOFMEMORY;
         CopyMediaType(*ppmt, &tmp);
 
-        LogMediaType("GetStreamCaps(out)", &tmp);
+        LogMediaType(VCAM_LOG_LEVEL_DEBUG, "GetStreamCaps(out)", &tmp);
         return S_OK;
     }
 
@@ -367,9 +671,128 @@ public:
         case RGB24: prop->cbBuffer = m_outW * m_outH * 3; break;
         case NV12:  prop->cbBuffer = m_outW * m_outH * 3 / 2; break;
         case I420:  prop->cbBuffer = m_outW * m_outH * 3 / 2; break;
+        case MJPG:  prop->cbBuffer = m_outW * m_outH * 3; break; // с запасом: JPEG меньше сырого BGR24
         }
+
+        // Буфер с границы 32 байт — тогда ядра пишут большой кадр в обход
+        // кэша. Если аллокатор приёмника такое выравнивание не принимает,
+        // остаёмся на запрошенном им.
+        const long requestedAlign = prop->cbAlign;
+        if (prop->cbAlign < 32)
+            prop->cbAlign = 32;
         ALLOCATOR_PROPERTIES actual = {};
-        return pAlloc->SetProperties(prop, &actual);
+        HRESULT hr = pAlloc->SetProperties(prop, &actual);
+        if (FAILED(hr) && prop->cbAlign != requestedAlign)
+        {
+            prop->cbAlign = requestedAlign;
+            hr = pAlloc->SetProperties(prop, &actual);
+        }
+        return hr;
+    }
+
+    // Размер JPEG в текущем слоте писателя. MJPG предлагаем и принимаем
+    // только в нём: масштабировать JPEG без декодера нечем, а кадр другого
+    // размера FillCompressed отдать не сможет
+    bool CurrentJpegSize(int* w, int* h) const
+    {
+        int jw = 0, jh = 0;
+        const FrameRead read = m_shm.ReadFrame([&](const SharedFrame& frame)
+        {
+            if (frame.fourcc == SHM_FOURCC_MJPG)
+            {
+                jw = frame.width;
+                jh = frame.height;
+            }
+        });
+        if (read != FrameRead::Ok || jw <= 0 || jh <= 0 || (jw & 1) || (jh & 1))
+            return false;
+        *w = jw;
+        *h = jh;
+        return true;
+    }
+
+    bool IsJpegSize(int w, int h) const
+    {
+        int jw = 0, jh = 0;
+        return CurrentJpegSize(&jw, &jh) && w == jw && h == jh;
+    }
+
+    // Формат выхода в терминах разделяемой памяти — для таблицы читателей
+    DWORD OutputFourCC() const
+    {
+        switch (m_format)
+        {
+        case NV12:  return SHM_FOURCC_NV12;
+        case I420:  return SHM_FOURCC_I420;
+        case YUY2:  return SHM_FOURCC_YUY2;
+        case RGB24: return SHM_FOURCC_BGR24;
+        case MJPG:  return SHM_FOURCC_MJPG;
+        default:    return 0;
+        }
+    }
+
+    // Кадр писателя, который можно отдать как есть: тот же формат, размер
+    // и плотно упакованные строки
+    bool IsNativeFrame(const SharedFrame& f) const
+    {
+        if (f.width != m_outW || f.height != m_outH)
+            return false;
+        switch (m_format)
+        {
+        case RGB24: return f.fourcc == SHM_FOURCC_BGR24 && f.stride == m_outW * 3;
+        case NV12:  return f.fourcc == SHM_FOURCC_NV12 && f.stride == m_outW;
+        case I420:  return f.fourcc == SHM_FOURCC_I420 && f.stride == m_outW;
+        case MJPG:  return f.fourcc == SHM_FOURCC_MJPG;  // размер сверен выше: без декодера его не поменять
+        default:    return false;   // YUY2 писатель не присылает
+        }
+    }
+
+    // Для форматов, которые писатель умеет присылать, предлагаем приёмнику
+    // свой аллокатор (семплы только для чтения — это память писателя).
+    // Совпадёт ли кадр, видно только по нему самому, поэтому FillBuffer
+    // проверяет каждый. Если приёмник аллокатор не принял, работаем по
+    // обычной схеме с копированием.
+    HRESULT DecideAllocator(IMemInputPin* pPin, IMemAllocator** ppAlloc) override
+    {
+        m_zeroCopy = false;
+        if (m_format != YUY2)
+        {
+            ALLOCATOR_PROPERTIES prop = {};
+            pPin->GetAllocatorRequirements(&prop);
+            if (prop.cbAlign == 0)
+                prop.cbAlign = 1;
+
+            HRESULT hr = S_OK;
+            CShmAllocator* alloc = new CShmAllocator(&m_shm, &hr);
+            alloc->AddRef();
+            if (SUCCEEDED(hr))
+                hr = DecideBufferSize(alloc, &prop);
+            if (SUCCEEDED(hr))
+                hr = pPin->NotifyAllocator(alloc, TRUE);
+            if (SUCCEEDED(hr))
+            {
+                *ppAlloc = alloc;
+                m_zeroCopy = true;
+                VCAM_LOG_INFO("vCam: Аллокатор без копирования принят\n");
+                return S_OK;
+            }
+            alloc->Release();
+            VCAM_LOG_INFO("vCam: Приёмник не принял аллокатор без копирования (0x%08lX)\n", hr);
+        }
+        return CSourceStream::DecideAllocator(pPin, ppAlloc);
+    }
+
+    // Базовая проверка сравнивает с GetMediaType(CMediaType*); MJPG сверх
+    // того годится только в размере JPEG, который сейчас шлёт писатель
+    HRESULT CheckMediaType(const CMediaType* pmt) override
+    {
+        if (pmt->subtype == MEDIASUBTYPE_MJPG)
+        {
+            const BITMAPINFOHEADER* bmi = GetBmiHeader(pmt);
+            if (!bmi || !IsJpegSize(bmi->biWidth, abs(bmi->biHeight)))
+                return E_INVALIDARG;
+        }
+        return CSourceStream::CheckMediaType(pmt);
     }
 
     // Запоминаем выбранный формат
@@ -386,26 +809,37 @@ public:
             m_format = NV12;
         else if (pmt->subtype == MEDIASUBTYPE_I420)
             m_format = I420;
+        else if (pmt->subtype == MEDIASUBTYPE_MJPG)
+            m_format = MJPG;
         else
             return E_INVALIDARG;
+        BindConverter();
 
-        VIDEOINFOHEADER* vih = reinterpret_cast<VIDEOINFOHEADER*>(pmt->pbFormat);
-        if (!vih) return E_INVALIDARG;
-        
-        // Получаем запрошенное разрешение для логов
-        const int requestedW = vih->bmiHeader.biWidth;
-        const int requestedH = abs(vih->bmiHeader.biHeight);
+        const BITMAPINFOHEADER* bmi = GetBmiHeader(pmt);
+        if (!bmi) return E_INVALIDARG;
         
-        // Всегда используем FULL HD разрешение
-        m_outW = FRAME_W;
-        m_outH = FRAME_H;
-        
-        char buf[128] = {};
-        sprintf_s(buf, "vCam: SetMediaType установлено Full HD: %dx%d вместо %dx%d\n", 
-                 FRAME_W, FRAME_H, requestedW, requestedH);
-        WriteLogFile(buf);
+        // Выдаём кадр в запрошенном разрешении; размеры YUV 4:2:0/4:2:2 должны быть чётными
+        const int requestedW = bmi->biWidth;
+        const int requestedH = abs(bmi->biHeight);
+        if (requestedW <= 0 || requestedH <= 0 || (requestedW & 1) || (requestedH & 1))
+            return E_INVALIDARG;
+        if (m_format == MJPG && !IsJpegSize(requestedW, requestedH))
+            return E_INVALIDARG;
+
+        m_outW = requestedW;
+        m_outH = requestedH;
+        m_colorSpace = ColorSpaceFromMediaType(pmt, requestedH);
+
+        // Таблицы масштабирования строим сразу под ожидаемый размер кадров
+        // писателя; если он пришлёт другой, FillBuffer перестроит их один раз
+        m_scale.Build(static_cast<int>(FRAME_W), static_cast<int>(FRAME_H), m_outW, m_outH);
+
+        VCAM_LOG_INFO("vCam: SetMediaType установлено: %dx%d, %s (источник %dx%d)\n",
+                      requestedW, requestedH, ColorSpaceName(m_colorSpace), FRAME_W, FRAME_H);
 
         m_mt.Set(*pmt);
+        // Писатель публикует кадры не больше, чем просят запущенные пины
+        m_shm.SetDemand(OutputFourCC(), m_outW, m_outH);
         LogMediaType("SetMediaType", pmt);
         return CSourceStream::SetMediaType(pmt);
     }
@@ -418,13 +852,31 @@ public:
         static const int sizes[][2] = { {1920,1080}, {1280,720}, {960,540}, {640,480} };
         const int sizeCount = _countof(sizes);
         const int formatsPerSize = 4; // YUY2, NV12, I420, RGB24
-        if (iPos >= sizeCount * formatsPerSize) return VFW_S_NO_MORE_ITEMS;
+        const int info2PerSize   = 3; // YUY2, NV12, I420 ещё раз, в VIDEOINFOHEADER2
+        const int fixedCount = sizeCount * (formatsPerSize + info2PerSize);
+
+        // MJPG — последним и только в размере JPEG писателя
+        int jpegW = 0, jpegH = 0;
+        const bool mjpg = iPos == fixedCount && CurrentJpegSize(&jpegW, &jpegH);
+        if (iPos >= fixedCount && !mjpg) return VFW_S_NO_MORE_ITEMS;
 
+        // Старые типы идут первыми, чтобы выбор приложений по умолчанию не менялся
+        const bool info2 = !mjpg && iPos >= sizeCount * formatsPerSize;
         int sizeIdx   = iPos / formatsPerSize;
-        int formatIdx = iPos % formatsPerSize; // 0=YUY2,1=NV12,2=I420,3=RGB24
+        int formatIdx = iPos % formatsPerSize; // 0=YUY2,1=NV12,2=I420,3=RGB24,4=MJPG
+        if (info2)
+        {
+            sizeIdx   = (iPos - sizeCount * formatsPerSize) / info2PerSize;
+            formatIdx = (iPos - sizeCount * formatsPerSize) % info2PerSize;
+        }
+        if (mjpg)
+        {
+            sizeIdx   = 0;
+            formatIdx = 4;
+        }
 
-        const int w = sizes[sizeIdx][0];
-        const int h = sizes[sizeIdx][1];
+        const int w = mjpg ? jpegW : sizes[sizeIdx][0];
+        const int h = mjpg ? jpegH : sizes[sizeIdx][1];
 
         VIDEOINFOHEADER* vih = reinterpret_cast<VIDEOINFOHEADER*>(pmt->AllocFormatBuffer(sizeof(VIDEOINFOHEADER)));
         ZeroMemory(vih, sizeof(VIDEOINFOHEADER));
@@ -458,7 +910,7 @@ public:
             vih->bmiHeader.biSizeImage   = w*h*3/2;
             sub = MEDIASUBTYPE_I420;
         }
-        else // RGB24
+        else if (formatIdx == 3) // RGB24
         {
             vih->bmiHeader.biHeight  = h; // bottom-up
             vih->bmiHeader.biBitCount= 24;
@@ -466,6 +918,14 @@ public:
             vih->bmiHeader.biSizeImage   = w*h*3;
             sub = MEDIASUBTYPE_RGB24;
         }
+        else // MJPG — JPEG телефона без перекодирования
+        {
+            vih->bmiHeader.biHeight  = h;
+            vih->bmiHeader.biBitCount= 24;
+            vih->bmiHeader.biCompression = MAKEFOURCC('M','J','P','G');
+            vih->bmiHeader.biSizeImage   = w*h*3; // верхняя граница
+            sub = MEDIASUBTYPE_MJPG;
+        }
 
         vih->AvgTimePerFrame = m_rtFrameLength;
 
@@ -473,12 +933,15 @@ public:
         pmt->SetSubtype(&sub);
         pmt->SetFormatType(&FORMAT_VideoInfo);
         pmt->SetTemporalCompression(FALSE);
-        pmt->SetSampleSize(vih->bmiHeader.biSizeImage);
+        if (formatIdx == 4)
+            pmt->SetVariableSize();
+        else
+            pmt->SetSampleSize(vih->bmiHeader.biSizeImage);
+        if (info2)
+            ToVideoInfo2(pmt, OfferedColorSpace(h));
 
-        char buf[128];
-        sprintf_s(buf, "vCam: GetMediaType iPos=%d format=%s %dx%d\n", iPos,
-                  (formatIdx==0?"YUY2":(formatIdx==1?"NV12":(formatIdx==2?"I420":"RGB24"))), w, h);
-        WriteLogFile(buf);
+        VCAM_LOG_DEBUG("vCam: GetMediaType iPos=%d format=%s %dx%d%s\n", iPos, GuidName(sub), w, h,
+                       info2 ? " VIH2" : "");
 
         return S_OK;
     }
@@ -770,6 +1233,240 @@ public:
     //    return S_OK;
     //}
     
+    // Запоминаем, какому времени опорных часов соответствует stream time 0,
+    // и сами часы. Run вызывается под блокировкой фильтра, поэтому здесь
+    // GetSyncSource безопасен; поток кадров её не берёт — иначе Stop,
+    // пришедший, пока поток ждёт часов, держит её и ждёт поток.
+    HRESULT Run(REFERENCE_TIME tStart) override
+    {
+        IReferenceClock* clock = nullptr;
+        if (FAILED(m_pFilter->GetSyncSource(&clock)))
+            clock = nullptr;
+        {
+            CAutoLock lock(&m_clockLock);
+            if (m_clock)
+                m_clock->Release();
+            m_clock = clock; // ссылка из GetSyncSource переходит к нам
+            m_rtStreamStart = tStart;
+        }
+        return CSourceStream::Run(tStart);
+    }
+
+    void ReleaseClock()
+    {
+        CAutoLock lock(&m_clockLock);
+        if (m_clock)
+        {
+            m_clock->Release();
+            m_clock = nullptr;
+        }
+    }
+
+    HRESULT OnThreadCreate() override
+    {
+        m_hPaceEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        m_rtSampleTime = 0;
+        m_pool.Start();
+        if (StreamingStoreThreshold() == SIZE_MAX)
+            VCAM_LOG_INFO("vCam: Потоков конвертации: %d, запись только через кэш\n", m_pool.Threads());
+        else
+            VCAM_LOG_INFO("vCam: Потоков конвертации: %d, запись в обход кэша для кадров больше %zu КБ\n",
+                          m_pool.Threads(), StreamingStoreThreshold() / 1024);
+        return CSourceStream::OnThreadCreate();
+    }
+
+    // Писатель без запущенных пинов не декодирует и не публикует кадры —
+    // отмечаемся до первого FillBuffer, чтобы он проснулся как можно раньше
+    HRESULT OnThreadStartPlay() override
+    {
+        m_shm.SetStreaming(true);
+        return CSourceStream::OnThreadStartPlay();
+    }
+
+    HRESULT Inactive() override
+    {
+        m_shm.SetStreaming(false);
+        const HRESULT hr = CSourceStream::Inactive();
+        ReleaseClock(); // поток кадров уже остановлен
+        return hr;
+    }
+
+    HRESULT OnThreadDestroy() override
+    {
+        m_pool.Stop();
+        ReleaseClock();
+        if (m_hPaceEvent)
+        {
+            CloseHandle(m_hPaceEvent);
+            m_hPaceEvent = nullptr;
+        }
+        return CSourceStream::OnThreadDestroy();
+    }
+
+    // Ждёт по опорным часам графа начала слота m_rtSampleTime. Если слот уже
+    // прошёл целиком, просроченные кадры пропускаются (в таймстемпах будет
+    // разрыв, как у живой камеры). Возвращает false, если часов нет или граф
+    // не в состоянии Run — тогда темп задаёт приёмник.
+    // Берёт только часы, сохранённые в Run(): GetSyncSource захватывает
+    // блокировку фильтра, а её держит Stop, пока ждёт этот поток.
+    // GetState базового фильтра блокировку не берёт.
+    bool PaceToClock()
+    {
+        FILTER_STATE state = State_Stopped;
+        if (!m_hPaceEvent || FAILED(m_pFilter->GetState(0, &state)) || state != State_Running)
+            return false;
+
+        IReferenceClock* clock = nullptr;
+        REFERENCE_TIME streamStart = 0;
+        {
+            CAutoLock lock(&m_clockLock);
+            clock = m_clock;
+            streamStart = m_rtStreamStart;
+            if (clock)
+                clock->AddRef(); // Run() может сменить часы, пока мы ждём
+        }
+        if (!clock)
+            return false;
+
+        REFERENCE_TIME now = 0;
+        clock->GetTime(&now);
+        const REFERENCE_TIME streamNow = now - streamStart;
+
+        if (streamNow >= m_rtSampleTime + m_rtFrameLength)
+        {
+            const REFERENCE_TIME missed = (streamNow - m_rtSampleTime) / m_rtFrameLength;
+            m_rtSampleTime += missed * m_rtFrameLength;
+            m_lateFramesSkipped += missed;
+            VCAM_LOG_WARN_EVERY(1000, "vCam: Опоздание, пропущено кадров: %lld (всего %llu)\n",
+                                missed, m_lateFramesSkipped);
+        }
+        else if (streamNow < m_rtSampleTime)
+        {
+            // Разовое уведомление часов; ждём не дольше двух кадров, чтобы
+            // Stop/Pause не зависели от часов
+            ResetEvent(m_hPaceEvent);
+            DWORD_PTR cookie = 0;
+            if (SUCCEEDED(clock->AdviseTime(streamStart, m_rtSampleTime,
+                                            reinterpret_cast<HEVENT>(m_hPaceEvent), &cookie)))
+            {
+                WaitForSingleObject(m_hPaceEvent, static_cast<DWORD>(2 * m_rtFrameLength / 10000));
+                clock->Unadvise(cookie);
+            }
+        }
+        clock->Release();
+        return true;
+    }
+
+    // MJPG: JPEG писателя уходит приёмнику байт в байт. Перекодировать
+    // нечем и сжатого чёрного кадра нет, поэтому без свежего JPEG нужного
+    // размера повторяем последний отданный, а до первого JPEG ждём.
+    // S_FALSE — граф останавливают, пока ждём.
+    HRESULT FillCompressed(IMediaSample* pSample, BYTE* pData, long cbData)
+    {
+        const DWORD periodMs = static_cast<DWORD>(m_rtFrameLength / 10000);
+        long length = 0;
+        for (;;)
+        {
+            // Свой аллокатор — семпл указывает прямо в слот
+            if (m_zeroCopy)
+            {
+                SharedFrame frame;
+                const int slot = m_shm.PinLatest(&frame);
+                if (slot >= 0 && IsNativeFrame(frame))
+                {
+                    static_cast<CShmSample*>(pSample)->AttachSlot(slot, frame.data, static_cast<LONG>(frame.size));
+                    m_lastId = frame.frameId;
+                    ++m_zeroCopyFrames;
+                    length = static_cast<long>(frame.size);
+                    break;
+                }
+                if (slot >= 0)
+                    m_shm.Unpin(slot);
+            }
+
+            LONG frameId = -1;
+            const FrameRead read = m_shm.ReadFrame([&](const SharedFrame& frame)
+            {
+                length = 0;
+                frameId = frame.frameId;
+                if (!IsNativeFrame(frame))
+                {
+                    VCAM_LOG_WARN_EVERY(1000, "vCam: Для MJPG нужен JPEG %dx%d, в слоте %.4s %dx%d\n",
+                                        m_outW, m_outH, reinterpret_cast<const char*>(&frame.fourcc),
+                                        frame.width, frame.height);
+                    return;
+                }
+                if (static_cast<long>(frame.size) > cbData)
+                {
+                    VCAM_LOG_WARN_EVERY(1000, "vCam: JPEG %lu байт не помещается в семпл %ld байт\n",
+                                        frame.size, cbData);
+                    return;
+                }
+                memcpy(pData, frame.data, frame.size);
+                length = static_cast<long>(frame.size);
+            });
+
+            // Оборванный JPEG не декодируется — такой не отдаём и не кэшируем
+            if (read == FrameRead::Ok && length > 0)
+            {
+                m_lastId = frameId;
+                ++m_cacheMisses;
+                // Копию для повтора делаем, только когда тот же JPEG просят второй раз
+                if (frameId == m_cache.sentId)
+                {
+                    m_cache.data.assign(pData, pData + length);
+                    m_cache.frameId = frameId;
+                    m_cache.format  = MJPG;
+                    m_cache.width   = m_outW;
+                    m_cache.height  = m_outH;
+                    m_cache.valid   = true;
+                }
+                m_cache.sentId = frameId;
+                break;
+            }
+            if (read == FrameRead::Torn)
+                VCAM_LOG_WARN_EVERY(1000, "vCam: JPEG %d перезаписан во время чтения\n", frameId);
+            length = 0;
+            // Неподходящий кадр тоже считаем увиденным: иначе WaitForNewFrame
+            // сразу возвращается, и поток крутится на нём, пока писатель
+            // не пришлёт следующий
+            if (read == FrameRead::Ok)
+                m_lastId = frameId;
+
+            if (m_cache.valid && m_cache.format == MJPG && m_cache.width == m_outW && m_cache.height == m_outH &&
+                m_cache.data.size() <= static_cast<size_t>(cbData))
+            {
+                length = static_cast<long>(m_cache.data.size());
+                memcpy(pData, m_cache.data.data(), length);
+                ++m_cacheHits;
+                break;
+            }
+
+            // Ни одного JPEG ещё не было: ждём его, но не мешаем остановить граф.
+            // Пока ждём, heartbeat продолжает идти — иначе писатель решит,
+            // что пин простаивает, и JPEG так и не опубликует.
+            m_shm.UpdateReader(m_lastId);
+            if (CheckRequest(nullptr))
+                return S_FALSE;
+            if (m_shm.Get())
+                m_shm.WaitForNewFrame(m_lastId, periodMs);
+            else
+                Sleep(periodMs);
+        }
+
+        // Как и в FillBuffer: писатель видит пин живым и учитывает его спрос
+        m_shm.UpdateReader(m_lastId);
+
+        pSample->SetActualDataLength(length);
+
+        REFERENCE_TIME rtStart = m_rtSampleTime;
+        REFERENCE_TIME rtEnd = rtStart + m_rtFrameLength;
+        pSample->SetTime(&rtStart, &rtEnd);
+        pSample->SetSyncPoint(TRUE);   // каждый JPEG — самостоятельный кадр
+        m_rtSampleTime = rtEnd;
+        return S_OK;
+    }
+
     // Записываем данные кадра в буфер семпла
 
     HRESULT FillBuffer(IMediaSample* pSample) override
@@ -779,17 +1476,34 @@ public:
         pSample->GetPointer(&pData);
         cbData = pSample->GetSize();
 
-        // Если память ещё не открыта — пытаемся открыть повторно
-        if (!m_shm.Get())
+        // Память подключает фоновый поток; здесь только отмечаем момент,
+        // когда указатель появился
+        const SharedHeader* hdr = m_shm.Get();
+        if (hdr && !m_shmReported)
         {
-            bool opened = m_shm.Open();
-            char buf[128] = {};
-            sprintf_s(buf, "vCam: SharedMem open %s\n", opened ? "успешно" : "ошибка");
-            WriteLogFile(buf);
+            m_shmReported = true;
+            VCAM_LOG_INFO("vCam: SharedMem подключена, доступ %s, страницы %s\n",
+                          m_shm.IsWritable() ? "чтение/запись" : "только чтение",
+                          m_shm.UsesLargePages() ? "большие" : "обычные");
         }
 
-        const SharedHeader* hdr = m_shm.Get();
-        long expectedSize;
+        // Если у графа есть опорные часы, выдаём кадр ровно в начале его слота.
+        // Иначе спим до публикации нового кадра, но не дольше периода кадра:
+        // без этого цикл CSourceStream гоняет конвертацию одного и того же
+        // кадра так быстро, как его принимает приёмник
+        if (!PaceToClock())
+        {
+            const DWORD periodMs = static_cast<DWORD>(m_rtFrameLength / 10000);
+            if (hdr)
+                m_shm.WaitForNewFrame(m_lastId, periodMs);
+            else
+                Sleep(periodMs); // писателя ещё нет — отдаём чёрные кадры в темпе потока
+        }
+
+        if (m_format == MJPG)
+            return FillCompressed(pSample, pData, cbData);
+
+        long expectedSize = 0;
         switch (m_format)
         {
         case YUY2: expectedSize = m_outW * m_outH * 2; break;
@@ -830,189 +1544,137 @@ public:
         }
 
         bool copied = false;
-        // Проверяем, есть ли в памяти какой-либо кадр (даже если он не изменился)
-        // Читаем индекс активного буфера атомарно
-        int currentBuffer = hdr->currentBuffer.load(std::memory_order_acquire);
-        DWORD currentDataSize = hdr->dataSize.load(std::memory_order_acquire);
-        if (currentDataSize == FRAME_SZ)
+
+        // Родной формат и свой аллокатор — семпл указывает прямо в слот,
+        // слот освободится, когда приёмник отпустит семпл
+        if (m_zeroCopy)
         {
-            LONG currentFrameId = hdr->frameId.load(std::memory_order_acquire);
-            if (currentFrameId != m_lastId) {
-                char buf[128] = {};
-                sprintf_s(buf, "vCam: Новый кадр, frameId=%d, предыдущий=%d\n", currentFrameId, m_lastId);
-                WriteLogFile(buf);
-                // Обновляем ID только когда он меняется
-                m_lastId = currentFrameId;
+            SharedFrame frame;
+            const int slot = m_shm.PinLatest(&frame);
+            if (slot >= 0 && IsNativeFrame(frame))
+            {
+                static_cast<CShmSample*>(pSample)->AttachSlot(slot, frame.data, static_cast<LONG>(frame.size));
+                m_lastId = frame.frameId;
+                ++m_zeroCopyFrames;
+                copied = true;
             }
-
-            // Используем данные из активного буфера
-            const BYTE* frameData = hdr->data[currentBuffer];
-            const bool bottomUp = true;
-            if (m_format == YUY2)
+            else if (slot >= 0)
             {
-                char buf[128] = {};
-                sprintf_s(buf, "vCam: Конвертация в YUY2 формат, размер кадра: %dx%d\n", m_outW, m_outH);
-                WriteLogFile(buf);
-
-                // Конвертация блока RGB24 (BGR) -> YUY2, два пикселя за проход
-                const BYTE* src = frameData;
-                BYTE* dst = pData;
-
-                // RGB -> YUV конверсия
-                auto RGB2Y = [](BYTE R, BYTE G, BYTE B)->BYTE {int Y = (66 * R + 129 * G + 25 * B + 128) >> 8; return static_cast<BYTE>(Y + 16); };
-                auto RGB2U = [](BYTE R, BYTE G, BYTE B)->BYTE {int U = (-38 * R - 74 * G + 112 * B + 128) >> 8; return static_cast<BYTE>(U + 128); };
-                auto RGB2V = [](BYTE R, BYTE G, BYTE B)->BYTE {int V = (112 * R - 94 * G - 18 * B + 128) >> 8; return static_cast<BYTE>(V + 128); };
+                m_shm.Unpin(slot);  // кадр другого формата — конвертируем как обычно
+            }
+            VCAM_LOG_INFO_EVERY(10000, "vCam: Кадров без копирования: %llu\n", m_zeroCopyFrames);
+        }
 
-                for (int y = 0; y < m_outH; ++y)
-                {
-                    // Вычисляем соответствующую строку во входном изображении
-                    // с учетом масштабирования
-                    int srcY = (y * FRAME_H) / m_outH;
-                    if (bottomUp) srcY = FRAME_H - 1 - srcY;
-                    const BYTE* line = src + srcY * FRAME_W * 3;
-
-                    for (int x = 0; x < m_outW; x += 2)
-                    {
-                        // Масштабируем координаты x для входного изображения
-                        int srcX1 = (x * FRAME_W) / m_outW;
-                        int srcX2 = ((x + 1) * FRAME_W) / m_outW;
-
-                        // первый пиксель BGR с масштабированием
-                        BYTE B1 = line[srcX1 * 3];
-                        BYTE G1 = line[srcX1 * 3 + 1];
-                        BYTE R1 = line[srcX1 * 3 + 2];
-
-                        // второй пиксель BGR с масштабированием
-                        BYTE B2 = line[srcX2 * 3];
-                        BYTE G2 = line[srcX2 * 3 + 1];
-                        BYTE R2 = line[srcX2 * 3 + 2];
-
-                        BYTE Y1 = RGB2Y(R1, G1, B1);
-                        BYTE Y2 = RGB2Y(R2, G2, B2);
-                        BYTE U = RGB2U(R1, G1, B1);
-                        BYTE V = RGB2V(R1, G1, B1);
-
-                        *dst++ = Y1; *dst++ = U; *dst++ = Y2; *dst++ = V;
-                    }
-                }
+        if (!copied)
+        {
+            // Тот же кадр в том же формате уже конвертировали — просто копируем
+            const LONG publishedId = hdr ? hdr->frameId.load(std::memory_order_acquire) : -1;
+            if (m_cache.valid && m_cache.frameId == publishedId &&
+                m_cache.format == m_format && m_cache.colorSpace == OutputColorSpace() &&
+                m_cache.width == m_outW && m_cache.height == m_outH &&
+                m_cache.data.size() == static_cast<size_t>(expectedSize))
+            {
+                memcpy(pData, m_cache.data.data(), expectedSize);
+                ++m_cacheHits;
+                copied = true;
             }
-            else if (m_format == RGB24)
+        }
+
+        // Берём последний опубликованный кадр (даже если он не изменился).
+        // Буфер проверяется seqlock'ом: если писатель начал его перезаписывать
+        // во время конвертации, конвертация повторяется с новым кадром.
+        if (!copied)
+        {
+            LONG currentFrameId = -1;
+            bool converted = false;
+            const FrameRead read = m_shm.ReadFrame([&](const SharedFrame& frame)
             {
-                // Если требуется RGB24
-                // При запросе любого разрешения, мы всегда выдаём Full HD,
-                // так что m_outW и m_outH всегда должны быть равны FRAME_W и FRAME_H
-                // Но на всякий случай сохраняем проверку
-                if (m_outW == FRAME_W && m_outH == FRAME_H)
+                currentFrameId = frame.frameId;
+
+                // Ядро выбирается по формату кадра: писатель может сменить
+                // его в любой момент
+                if (frame.fourcc != m_convertSrc)
                 {
-                    CopyMemory(pData, frameData, expectedSize);
+                    m_convertSrc = frame.fourcc;
+                    BindConverter();
                 }
-                else
+                converted = m_convert != nullptr;
+                if (!converted)
                 {
-                    char buf[128] = {};
-                    sprintf_s(buf, "vCam: ВНИМАНИЕ - отличается размер кадра: %dx%d вместо %dx%d\n",
-                        m_outW, m_outH, FRAME_W, FRAME_H);
-                    WriteLogFile(buf);
-
-                    // cropped top-left without scaling, bottom-up
-                    for (int y = 0; y < m_outH; ++y)
-                    {
-                        const BYTE* srcLine = frameData + (FRAME_H - 1 - y) * FRAME_W * 3;
-                        BYTE* dstLine = pData + y * m_outW * 3;
-                        CopyMemory(dstLine, srcLine, m_outW * 3);
-                    }
+                    VCAM_LOG_WARN_EVERY(1000, "vCam: Нет преобразования для кадра %.4s %dx%d в %s\n",
+                                        reinterpret_cast<const char*>(&frame.fourcc), frame.width, frame.height,
+                                        GuidName(*m_mt.Subtype()));
+                    return;
                 }
-            }
-            else if (m_format == NV12)
+                VCAM_LOG_DEBUG_EVERY(1000, "vCam: Конвертация %.4s %dx%d в %s формат (%s, %s), размер кадра: %dx%d\n",
+                                     reinterpret_cast<const char*>(&frame.fourcc), frame.width, frame.height,
+                                     GuidName(*m_mt.Subtype()), CpuTierName(ActiveCpuTier()),
+                                     ColorSpaceName(OutputColorSpace()), m_outW, m_outH);
+
+                // Масштабирование до запрошенного размера идёт в том же проходе,
+                // что и преобразование цвета. BGR24 писателя и RGB24 оба
+                // bottom-up, YUV-форматы идут сверху вниз.
+                const bool bottomUp = frame.fourcc == SHM_FOURCC_BGR24;
+                ConvertArgs args = {};
+                args.src       = frame.data;
+                args.srcStride = frame.stride;
+                args.srcWidth  = frame.width;
+                args.srcHeight = frame.height;
+                args.dst       = pData;
+                args.width     = m_outW;
+                args.height    = m_outH;
+                args.flipV     = bottomUp != (m_format == RGB24);
+                args.colorSpace = OutputColorSpace();
+                args.srcColorSpace = kWriterYuvColorSpace;
+                m_scale.Build(frame.width, frame.height, m_outW, m_outH); // без изменений размера ничего не делает
+                args.scale     = &m_scale;
+                m_pool.Run(m_convert, args);
+            });
+
+            if (read != FrameRead::NoFrame && converted)
             {
-                char buf[128] = {};
-                sprintf_s(buf, "vCam: Конвертация в NV12 формат, размер кадра: %dx%d\n", m_outW, m_outH);
-                WriteLogFile(buf);
-
-                // Конвертация RGB24 (BGR) -> NV12
-                BYTE* yPlane = pData;
-                BYTE* uvPlane = pData + m_outW * m_outH;
-                for (int y = 0; y < m_outH; ++y)
-                {
-                    // Масштабируем координату Y
-                    int srcY = (y * FRAME_H) / m_outH;
-                    if (bottomUp) srcY = FRAME_H - 1 - srcY;
-                    const BYTE* line = frameData + srcY * FRAME_W * 3;
-
-                    for (int x = 0; x < m_outW; ++x)
-                    {
-                        // Масштабируем координату X
-                        int srcX = (x * FRAME_W) / m_outW;
-
-                        BYTE B = line[srcX * 3];
-                        BYTE G = line[srcX * 3 + 1];
-                        BYTE R = line[srcX * 3 + 2];
-
-                        int Y = (66 * R + 129 * G + 25 * B + 128) >> 8; // 0..255
-                        yPlane[y * m_outW + x] = (BYTE)(Y + 16);
-
-                        if ((y % 2) == 0 && (x % 2) == 0)
-                        {
-                            int U = (-38 * R - 74 * G + 112 * B + 128) >> 8;
-                            int V = (112 * R - 94 * G - 18 * B + 128) >> 8;
-                            uvPlane[(y / 2) * m_outW + x] = (BYTE)(U + 128); // U
-                            uvPlane[(y / 2) * m_outW + x + 1] = (BYTE)(V + 128); // V (next byte)
-                        }
-                    }
+                if (currentFrameId != m_lastId) {
+                    VCAM_LOG_TRACE_EVERY(1000, "vCam: Новый кадр, frameId=%d, предыдущий=%d\n", currentFrameId, m_lastId);
+                    // Обновляем ID только когда он меняется
+                    m_lastId = currentFrameId;
                 }
-            }
-            else if (m_format == I420)
-            {
-                char buf[128] = {};
-                sprintf_s(buf, "vCam: Конвертация в I420 формат, размер кадра: %dx%d\n", m_outW, m_outH);
-                WriteLogFile(buf);
-
-                // Конвертация RGB24 (BGR) -> I420 (Y plane, затем U, затем V)
-                BYTE* yPlane = pData;
-                BYTE* uPlane = pData + m_outW * m_outH;
-                BYTE* vPlane = uPlane + (m_outW * m_outH) / 4;
+                ++m_cacheMisses;
 
-                for (int y = 0; y < m_outH; ++y)
+                // Смешанный кадр в кэш не кладём. Целый — только при первом
+                // повторе: кадр, который больше не попросят, копировать незачем
+                if (read == FrameRead::Torn)
                 {
-                    // Масштабируем координату Y
-                    int srcY = (y * FRAME_H) / m_outH;
-                    if (bottomUp) srcY = FRAME_H - 1 - srcY;
-                    const BYTE* line = frameData + srcY * FRAME_W * 3;
-
-                    for (int x = 0; x < m_outW; ++x)
-                    {
-                        // Масштабируем координату X
-                        int srcX = (x * FRAME_W) / m_outW;
-
-                        BYTE B = line[srcX * 3];
-                        BYTE G = line[srcX * 3 + 1];
-                        BYTE R = line[srcX * 3 + 2];
-
-                        int Y = (66 * R + 129 * G + 25 * B + 128) >> 8;
-                        yPlane[y * m_outW + x] = (BYTE)(Y + 16);
-
-                        if ((y % 2) == 0 && (x % 2) == 0)
-                        {
-                            int U = (-38 * R - 74 * G + 112 * B + 128) >> 8;
-                            int V = (112 * R - 94 * G - 18 * B + 128) >> 8;
-                            size_t uvIndex = (y / 2) * (m_outW / 2) + (x / 2);
-                            uPlane[uvIndex] = (BYTE)(U + 128);
-                            vPlane[uvIndex] = (BYTE)(V + 128);
-                        }
-                    }
+                    m_cache.valid = false;
+                    VCAM_LOG_WARN_EVERY(1000, "vCam: Кадр %d перезаписан во время чтения\n", currentFrameId);
                 }
+                else if (currentFrameId == m_cache.sentId)
+                {
+                    m_cache.data.assign(pData, pData + expectedSize);
+                    m_cache.frameId = currentFrameId;
+                    m_cache.format  = m_format;
+                    m_cache.colorSpace = OutputColorSpace();
+                    m_cache.width   = m_outW;
+                    m_cache.height  = m_outH;
+                    m_cache.valid   = true;
+                }
+                if (read == FrameRead::Ok)
+                    m_cache.sentId = currentFrameId;
+                copied = true;
             }
-            copied = true;
         }
+        VCAM_LOG_INFO_EVERY(10000, "vCam: Кэш кадров: попаданий %llu, промахов %llu\n",
+                            m_cacheHits, m_cacheMisses);
 
         if (!copied)
         {
-            char buf[128] = {};
             // Явно загружаем атомарные значения
             LONG frameIdVal = hdr ? hdr->frameId.load(std::memory_order_acquire) : -1;
-            DWORD dataSizeVal = hdr ? hdr->dataSize.load(std::memory_order_acquire) : 0;
-            sprintf_s(buf, "vCam: Пустой кадр, hdr=%p, frameId=%d, dataSize=%d, lastId=%d\n",
-                hdr, frameIdVal, dataSizeVal, m_lastId);
-            WriteLogFile(buf);
+            DWORD slotSizeVal = hdr ? hdr->slotSize.load(std::memory_order_acquire) : 0;
+            // Сигнатура и версия видны в логе, если писатель другой версии
+            DWORD magicVal = hdr ? hdr->magic.load(std::memory_order_relaxed) : 0;
+            DWORD versionVal = hdr ? hdr->version.load(std::memory_order_acquire) : 0;
+            VCAM_LOG_WARN_EVERY(1000, "vCam: Пустой кадр, hdr=%p, magic=0x%08lx, version=%lu, frameId=%d, slotSize=%d, lastId=%d\n",
+                hdr, magicVal, versionVal, frameIdVal, slotSizeVal, m_lastId);
 
             // Чёрный кадр
             if (m_format == YUY2)
@@ -1036,6 +1698,10 @@ public:
             }
         }
 
+        // Писатель видит по таблице читателей, что пин жив и насколько
+        // отстаёт. Пустой кадр тоже считается: пин ждёт кадров.
+        m_shm.UpdateReader(m_lastId);
+
         // Сообщаем фактический объём данных
         pSample->SetActualDataLength(expectedSize);
 
@@ -1100,11 +1766,20 @@ public:
     CVCamSource(IUnknown* pUnk, HRESULT* phr)
         : CSource(NAME("vCamSource"), pUnk, CLSID_VCam)
     {
+        // Поток записи лога живёт, пока существует хотя бы один фильтр
+        LogStart();
         m_paStreams = (CSourceStream**)new CPushPinVCam*[1];
         m_paStreams[0] = new CPushPinVCam(phr, this);
         m_iPins = 1;
     }
 
+    ~CVCamSource()
+    {
+        // Пины удаляет ~CSource, он выполнится после этого тела;
+        // их сообщения будут дописаны при следующем LogStart или при выгрузке DLL
+        LogStop();
+    }
+
     static CUnknown* WINAPI CreateInstance(IUnknown* pUnk, HRESULT* phr)
     {
         return new CVCamSource(pUnk, phr);
@@ -1138,18 +1813,21 @@ int g_cTemplates = ARRAYSIZE(g_Templates);
 extern "C" BOOL WINAPI DllEntryPoint(HINSTANCE, ULONG, LPVOID);
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD fdwReason, LPVOID)
 {
-    char procBuf[260] = {};
     DWORD pid = GetCurrentProcessId();
     char name[MAX_PATH] = {};
     if (GetModuleFileNameA(NULL, name, MAX_PATH))
     {
         const char* base = strrchr(name, '\\');
         base = base ? base + 1 : name;
-        sprintf_s(procBuf, "vCam: %s (PID %lu) %s\n", base, pid,
-                  (fdwReason == DLL_PROCESS_ATTACH ? "DLL_PROCESS_ATTACH" : (fdwReason==DLL_PROCESS_DETACH?"DLL_PROCESS_DETACH":"OTHER")));
-        WriteLogFile(procBuf);
+        VCAM_LOG_INFO("vCam: %s (PID %lu) %s\n", base, pid,
+                      (fdwReason == DLL_PROCESS_ATTACH ? "DLL_PROCESS_ATTACH" : (fdwReason==DLL_PROCESS_DETACH?"DLL_PROCESS_DETACH":"OTHER")));
     }
 
+    // Фоновый поток лога здесь не создаётся и не ждётся (loader lock),
+    // поэтому хвост очереди дописываем синхронно
+    if (fdwReason == DLL_PROCESS_DETACH)
+        LogFlushNow();
+
     return DllEntryPoint((HINSTANCE)hModule, fdwReason, nullptr);
 }
 
@@ -0,0 +1,244 @@
+// ----------------------------------------------------------------------------
+// Качество BGR24 -> YUV против эталона в плавающей точке. Эталон считает
+// Y, U, V каждого пикселя точными формулами матрицы (BT.601/BT.709,
+// 16..235/0..255) и усредняет U/V по блоку 2x2 (4:2:0) или паре пикселей
+// (4:2:2) — то же, что должен делать фильтр цветности ядер. Для каждого
+// ядра каждого уровня, каждой матрицы и двух кадров (тонкие цветные линии
+// на градиенте и шум) считается PSNR плоскостей; ниже порога — ошибка.
+//
+// Порог должен отделять фильтр от прежней выборки левого верхнего пикселя
+// (LegacyConvert.h), поэтому тот же замер делается для прежнего цикла, и
+// он обязан порог не пройти — иначе кадры слишком гладкие для проверки.
+//
+// Сборка и запуск (Linux, x86-64, из каталога tests):
+//   S=../VirtualCamFilter
+//   g++ -O2 -std=c++17 -I$S -c $S/PixelConvert.cpp $S/PixelConvertYuv.cpp
+//   g++ -O2 -std=c++17 -mavx2 -I$S -c $S/PixelConvertAvx2.cpp
+//   g++ -O2 -std=c++17 -I$S ChromaQualityTest.cpp PixelConvert.o PixelConvertYuv.o PixelConvertAvx2.o -o chroma_quality
+//   ./chroma_quality
+// Код выхода 0 — все плоскости не хуже порога.
+// ----------------------------------------------------------------------------
+
+#include "PixelConvert.h"
+#include "LegacyConvert.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr int kWidth  = 1920;
+constexpr int kHeight = 1080;
+
+// Пороги PSNR, дБ. Ядра дают около 57 дБ по цветности и 50+ по яркости
+// (ошибка — округление фиксированной точки); прежняя выборка пикселя — не
+// выше 26 дБ по цветности на этих кадрах.
+constexpr double kMinLumaPsnr   = 48.0;
+constexpr double kMinChromaPsnr = 50.0;
+
+struct Matrix
+{
+    double kr, kb;
+    bool   full;
+};
+
+Matrix MatrixOf(ColorSpace cs)
+{
+    const bool bt709 = cs == ColorSpace::BT709Limited || cs == ColorSpace::BT709Full;
+    const bool full  = cs == ColorSpace::BT601Full || cs == ColorSpace::BT709Full;
+    return bt709 ? Matrix{ 0.2126, 0.0722, full } : Matrix{ 0.299, 0.114, full };
+}
+
+// Плоскости эталона: Y в полном размере, U и V — chromaRows строк по W/2
+struct Reference
+{
+    std::vector<double> y, u, v;
+};
+
+Reference MakeReference(const std::vector<uint8_t>& bgr, ColorSpace cs, bool is422)
+{
+    const Matrix m = MatrixOf(cs);
+    const double yScale = m.full ? 1.0 : 219.0 / 255.0;
+    const double cScale = m.full ? 1.0 : 224.0 / 255.0;
+    const double yOffset = m.full ? 0.0 : 16.0;
+    const int chromaRows = is422 ? kHeight : kHeight / 2;
+    const double weight = is422 ? 0.5 : 0.25;
+
+    Reference r;
+    r.y.assign(static_cast<size_t>(kWidth) * kHeight, 0.0);
+    r.u.assign(static_cast<size_t>(kWidth / 2) * chromaRows, 0.0);
+    r.v.assign(r.u.size(), 0.0);
+    for (int y = 0; y < kHeight; ++y)
+    {
+        // Источник bottom-up, как у писателя
+        const uint8_t* row = &bgr[static_cast<size_t>(kHeight - 1 - y) * kWidth * 3];
+        for (int x = 0; x < kWidth; ++x)
+        {
+            const double B = row[x * 3], G = row[x * 3 + 1], R = row[x * 3 + 2];
+            const double luma = m.kr * R + (1.0 - m.kr - m.kb) * G + m.kb * B;
+            r.y[static_cast<size_t>(y) * kWidth + x] = yOffset + yScale * luma;
+
+            const size_t c = static_cast<size_t>(is422 ? y : y / 2) * (kWidth / 2) + x / 2;
+            r.u[c] += weight * std::clamp(128.0 + cScale * (B - luma) / (2.0 * (1.0 - m.kb)), 0.0, 255.0);
+            r.v[c] += weight * std::clamp(128.0 + cScale * (R - luma) / (2.0 * (1.0 - m.kr)), 0.0, 255.0);
+        }
+    }
+    return r;
+}
+
+// PSNR плоскости: ref.size() отсчётов через step байт
+double Psnr(const uint8_t* p, size_t step, const std::vector<double>& ref)
+{
+    double se = 0.0;
+    for (size_t i = 0; i < ref.size(); ++i)
+    {
+        const double d = p[i * step] - ref[i];
+        se += d * d;
+    }
+    se /= static_cast<double>(ref.size());
+    return se > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / se) : 99.0;
+}
+
+struct Planes
+{
+    double y, u, v;
+};
+
+// PSNR Y/U/V выходного кадра формата fmt
+Planes Measure(PixelFormat fmt, const std::vector<uint8_t>& out, const Reference& r)
+{
+    const size_t luma = static_cast<size_t>(kWidth) * kHeight;
+    switch (fmt)
+    {
+    case PixelFormat::NV12:
+        return { Psnr(out.data(), 1, r.y), Psnr(out.data() + luma, 2, r.u), Psnr(out.data() + luma + 1, 2, r.v) };
+    case PixelFormat::I420:
+        return { Psnr(out.data(), 1, r.y), Psnr(out.data() + luma, 1, r.u), Psnr(out.data() + luma + luma / 4, 1, r.v) };
+    default: // YUY2: Y0 U Y1 V
+        return { Psnr(out.data(), 2, r.y), Psnr(out.data() + 1, 4, r.u), Psnr(out.data() + 3, 4, r.v) };
+    }
+}
+
+// Тонкие (1-2 пикселя) цветные линии и точки поверх плавного градиента
+std::vector<uint8_t> EdgesFrame()
+{
+    std::vector<uint8_t> f(static_cast<size_t>(kWidth) * kHeight * 3);
+    for (int y = 0; y < kHeight; ++y)
+    {
+        for (int x = 0; x < kWidth; ++x)
+        {
+            uint8_t* p = &f[(static_cast<size_t>(y) * kWidth + x) * 3];
+            p[0] = static_cast<uint8_t>(x * 255 / kWidth);
+            p[1] = static_cast<uint8_t>(y * 255 / kHeight);
+            p[2] = 128;
+            if ((x / 3) % 7 == 0 || ((y / 2) % 9 == 0 && x % 5 < 2))
+            {
+                p[0] = 255; p[1] = 20; p[2] = 20;
+            }
+            if ((x + y) % 11 == 0)
+            {
+                p[0] = 10; p[1] = 240; p[2] = 60;
+            }
+        }
+    }
+    return f;
+}
+
+std::vector<uint8_t> NoiseFrame()
+{
+    std::mt19937 rng(7);
+    std::vector<uint8_t> f(static_cast<size_t>(kWidth) * kHeight * 3);
+    for (auto& v : f)
+        v = static_cast<uint8_t>(rng());
+    return f;
+}
+
+} // namespace
+
+int main()
+{
+    const CpuTier detected = DetectCpuTier();
+    printf("Процессор: %s, кадр %dx%d, порог Y %.0f дБ, U/V %.0f дБ\n\n",
+           CpuTierName(detected), kWidth, kHeight, kMinLumaPsnr, kMinChromaPsnr);
+
+    struct Kernel { CpuTier tier; ConvertFn fn; };
+    struct Target
+    {
+        const char* name;
+        PixelFormat fmt;
+        Kernel      kernels[3];
+        void (*legacy)(const uint8_t*, uint8_t*, int, int, int, int);
+    };
+    const size_t luma = static_cast<size_t>(kWidth) * kHeight;
+    const Target targets[] =
+    {
+        { "NV12", PixelFormat::NV12,
+          { { CpuTier::Scalar, ConvertBGR24ToNV12_Scalar }, { CpuTier::SSE2, ConvertBGR24ToNV12_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToNV12_AVX2 } },
+          LegacyBGR24ToNV12 },
+        { "I420", PixelFormat::I420,
+          { { CpuTier::Scalar, ConvertBGR24ToI420_Scalar }, { CpuTier::SSE2, ConvertBGR24ToI420_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToI420_AVX2 } },
+          LegacyBGR24ToI420 },
+        { "YUY2", PixelFormat::YUY2,
+          { { CpuTier::Scalar, ConvertBGR24ToYUY2_Scalar }, { CpuTier::SSE2, ConvertBGR24ToYUY2_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToYUY2_AVX2 } },
+          LegacyBGR24ToYUY2 },
+    };
+    struct Frame { const char* name; std::vector<uint8_t> bgr; };
+    const Frame frames[] = { { "линии", EdgesFrame() }, { "шум", NoiseFrame() } };
+
+    int failures = 0;
+    std::vector<uint8_t> out(luma * 2);
+    printf("кадр   формат уровень  матрица          PSNR Y / U / V, дБ\n");
+    for (const Frame& frame : frames)
+    {
+        for (int csi = 0; csi < static_cast<int>(ColorSpace::Count); ++csi)
+        {
+            const ColorSpace cs = static_cast<ColorSpace>(csi);
+            const Reference ref420 = MakeReference(frame.bgr, cs, false);
+            const Reference ref422 = MakeReference(frame.bgr, cs, true);
+            for (const Target& t : targets)
+            {
+                const Reference& ref = t.fmt == PixelFormat::YUY2 ? ref422 : ref420;
+                for (const Kernel& k : t.kernels)
+                {
+                    if (k.tier > detected)
+                        continue;
+                    ConvertArgs a = {};
+                    a.src = frame.bgr.data();
+                    a.srcStride = kWidth * 3;
+                    a.srcWidth = kWidth;
+                    a.srcHeight = kHeight;
+                    a.dst = out.data();
+                    a.width = kWidth;
+                    a.height = kHeight;
+                    a.flipV = true;
+                    a.colorSpace = cs;
+                    k.fn(a);
+
+                    const Planes p = Measure(t.fmt, out, ref);
+                    const bool ok = p.y >= kMinLumaPsnr && p.u >= kMinChromaPsnr && p.v >= kMinChromaPsnr;
+                    if (!ok)
+                        ++failures;
+                    printf("%-6s %-6s %-8s %-16s %5.1f / %5.1f / %5.1f%s\n", frame.name, t.name, CpuTierName(k.tier),
+                           ColorSpaceName(cs), p.y, p.u, p.v, ok ? "" : "  НИЖЕ ПОРОГА");
+                }
+
+                // Прежний цикл знает только BT.601 16..235
+                if (cs != ColorSpace::BT601Limited)
+                    continue;
+                t.legacy(frame.bgr.data(), out.data(), kWidth, kHeight, kWidth, kHeight);
+                const Planes p = Measure(t.fmt, out, ref);
+                const bool separated = p.u < kMinChromaPsnr || p.v < kMinChromaPsnr;
+                if (!separated)
+                    ++failures;
+                printf("%-6s %-6s %-8s %-16s %5.1f / %5.1f / %5.1f  (прежний цикл%s)\n", frame.name, t.name, "legacy",
+                       ColorSpaceName(cs), p.y, p.u, p.v, separated ? "" : " прошёл порог — кадр не проверяет фильтр");
+            }
+        }
+    }
+
+    printf("\n%s\n", failures ? "ОШИБКА" : "Все плоскости не хуже порога");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+// ----------------------------------------------------------------------------
+// Замер ядер преобразования против прежнего скалярного цикла FillBuffer
+// (LegacyConvert.h). Кадр BGR24 1920x1080 bottom-up переводится в NV12,
+// I420 и YUY2 того же размера и в 1280x720; для каждого уровня ядер —
+// лучшее из нескольких прогонов, мс на кадр, и ускорение к прежнему циклу.
+// Прежний цикл масштабирует выбором ближайшего пикселя, ядра — билинейно,
+// так что при 1280x720 сравниваются не одинаковые по качеству пути.
+// Уровни выше возможностей процессора пропускаются.
+//
+// Сборка и запуск (Linux, x86-64, из каталога tests):
+//   S=../VirtualCamFilter
+//   g++ -O2 -std=c++17 -I$S -c $S/PixelConvert.cpp $S/PixelConvertYuv.cpp
+//   g++ -O2 -std=c++17 -mavx2 -I$S -c $S/PixelConvertAvx2.cpp
+//   g++ -O2 -std=c++17 -I$S KernelBench.cpp PixelConvert.o PixelConvertYuv.o PixelConvertAvx2.o -o kernel_bench
+//   ./kernel_bench
+// ----------------------------------------------------------------------------
+
+#include "PixelConvert.h"
+#include "LegacyConvert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <class Fn>
+double BestMillis(Fn&& fn)
+{
+    constexpr int kRuns = 7;
+    constexpr int kFrames = 10;
+    fn();   // прогрев: таблицы масштабирования, страницы выходного буфера
+    double best = 1e12;
+    for (int r = 0; r < kRuns; ++r)
+    {
+        const auto t = Clock::now();
+        for (int i = 0; i < kFrames; ++i)
+            fn();
+        best = std::min(best, std::chrono::duration<double, std::milli>(Clock::now() - t).count() / kFrames);
+    }
+    return best;
+}
+
+} // namespace
+
+int main()
+{
+    const int srcW = 1920, srcH = 1080;
+    const CpuTier detected = DetectCpuTier();
+    printf("Процессор: %s, источник BGR24 %dx%d\n\n", CpuTierName(detected), srcW, srcH);
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> src(static_cast<size_t>(srcW) * srcH * 3);
+    for (auto& v : src)
+        v = static_cast<uint8_t>(rng());
+    std::vector<uint8_t> dst(static_cast<size_t>(srcW) * srcH * 2);
+
+    struct Kernel { CpuTier tier; ConvertFn fn; };
+    struct Target
+    {
+        const char* name;
+        void (*legacy)(const uint8_t*, uint8_t*, int, int, int, int);
+        Kernel kernels[3];
+    };
+    const Target targets[] =
+    {
+        { "NV12", LegacyBGR24ToNV12,
+          { { CpuTier::Scalar, ConvertBGR24ToNV12_Scalar }, { CpuTier::SSE2, ConvertBGR24ToNV12_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToNV12_AVX2 } } },
+        { "I420", LegacyBGR24ToI420,
+          { { CpuTier::Scalar, ConvertBGR24ToI420_Scalar }, { CpuTier::SSE2, ConvertBGR24ToI420_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToI420_AVX2 } } },
+        { "YUY2", LegacyBGR24ToYUY2,
+          { { CpuTier::Scalar, ConvertBGR24ToYUY2_Scalar }, { CpuTier::SSE2, ConvertBGR24ToYUY2_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToYUY2_AVX2 } } },
+    };
+    const int outSizes[][2] = { { srcW, srcH }, { 1280, 720 } };
+
+    printf("выход            уровень     мс/кадр  ускорение\n");
+    for (const auto& o : outSizes)
+    {
+        const int w = o[0], h = o[1];
+        for (const Target& t : targets)
+        {
+            const double legacy = BestMillis([&] { t.legacy(src.data(), dst.data(), srcW, srcH, w, h); });
+            printf("%s %4dx%-5d  прежний   %8.3f\n", t.name, w, h, legacy);
+
+            for (const Kernel& k : t.kernels)
+            {
+                if (k.tier > detected)
+                    continue;
+                ConvertArgs a = {};
+                a.src = src.data();
+                a.srcStride = srcW * 3;
+                a.srcWidth = srcW;
+                a.srcHeight = srcH;
+                a.dst = dst.data();
+                a.width = w;
+                a.height = h;
+                a.flipV = true;
+                a.store = StoreMode::Cached;
+                const double ms = BestMillis([&] { k.fn(a); });
+                printf("%s %4dx%-5d  %-8s  %8.3f  %8.1fx\n", t.name, w, h, CpuTierName(k.tier), ms, legacy / ms);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,316 @@
+// ----------------------------------------------------------------------------
+// Проверка ядер преобразования против прежнего скалярного цикла FillBuffer
+// (LegacyConvert.h) и друг против друга. Проверяется:
+//   - BGR24 -> NV12/I420/YUY2 каждого уровня (scalar, sse2, avx2) в размере
+//     источника, BT.601 16..235, с переворотом совпадает с прежним циклом
+//     бит в бит. Цветность теперь — среднее блока 2x2 (2x1 для YUY2), а не
+//     левый верхний пиксель, поэтому кадр собран из одноцветных блоков 2x2:
+//     на нём оба способа дают одно и то же;
+//   - на случайном кадре SSE2 и AVX2 совпадают со скалярной версией бит в
+//     бит при всех матрицах, с переворотом и без, с хвостами строк, с
+//     масштабированием, по полосам строк и при записи в обход кэша;
+//   - кадры NV12/I420 от писателя в той же матрице переупаковываются без
+//     потерь: NV12 -> I420 даёт то же, что BGR24 -> I420, и наоборот.
+// Уровни выше возможностей процессора пропускаются.
+//
+// Сборка и запуск (Linux, x86-64, из каталога tests):
+//   S=../VirtualCamFilter
+//   g++ -O2 -std=c++17 -I$S -c $S/PixelConvert.cpp $S/PixelConvertYuv.cpp
+//   g++ -O2 -std=c++17 -mavx2 -I$S -c $S/PixelConvertAvx2.cpp
+//   g++ -O2 -std=c++17 -I$S KernelTest.cpp PixelConvert.o PixelConvertYuv.o PixelConvertAvx2.o -o kernel_test
+//   ./kernel_test
+// Код выхода 0 — расхождений нет.
+// ----------------------------------------------------------------------------
+
+#include "PixelConvert.h"
+#include "LegacyConvert.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Kernel
+{
+    CpuTier   tier;
+    ConvertFn fn;
+};
+
+struct Target
+{
+    const char* name;
+    PixelFormat fmt;
+    int         num, den;   // байт на пиксель: num / den
+    Kernel      kernels[3];
+    void (*legacy)(const uint8_t*, uint8_t*, int, int, int, int);
+};
+
+const Target kTargets[] =
+{
+    { "NV12", PixelFormat::NV12, 3, 2,
+      { { CpuTier::Scalar, ConvertBGR24ToNV12_Scalar }, { CpuTier::SSE2, ConvertBGR24ToNV12_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToNV12_AVX2 } },
+      LegacyBGR24ToNV12 },
+    { "I420", PixelFormat::I420, 3, 2,
+      { { CpuTier::Scalar, ConvertBGR24ToI420_Scalar }, { CpuTier::SSE2, ConvertBGR24ToI420_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToI420_AVX2 } },
+      LegacyBGR24ToI420 },
+    { "YUY2", PixelFormat::YUY2, 2, 1,
+      { { CpuTier::Scalar, ConvertBGR24ToYUY2_Scalar }, { CpuTier::SSE2, ConvertBGR24ToYUY2_SSE2 }, { CpuTier::AVX2, ConvertBGR24ToYUY2_AVX2 } },
+      LegacyBGR24ToYUY2 },
+};
+
+int g_failures = 0;
+int g_checks = 0;
+
+size_t FrameBytes(const Target& t, int w, int h)
+{
+    return static_cast<size_t>(w) * h * t.num / t.den;
+}
+
+// Выходной буфер, выровненный на 64 байта (для записи в обход кэша)
+struct AlignedBuffer
+{
+    explicit AlignedBuffer(size_t n) : size(n), data(static_cast<uint8_t*>(aligned_alloc(64, (n + 63) / 64 * 64))) {}
+    ~AlignedBuffer() { free(data); }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    size_t   size;
+    uint8_t* data;
+};
+
+void Expect(const char* what, const uint8_t* got, const uint8_t* want, size_t bytes)
+{
+    ++g_checks;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        if (got[i] != want[i])
+        {
+            printf("FAIL %s: байт %zu из %zu: %u, ожидалось %u\n", what, i, bytes, got[i], want[i]);
+            ++g_failures;
+            return;
+        }
+    }
+}
+
+std::vector<uint8_t> RandomFrame(std::mt19937& rng, int h, int stride)
+{
+    std::vector<uint8_t> f(static_cast<size_t>(stride) * h);
+    for (auto& v : f)
+        v = static_cast<uint8_t>(rng());
+    return f;
+}
+
+// Случайные цвета одноцветными блоками 2x2
+std::vector<uint8_t> BlockFrame(std::mt19937& rng, int w, int h)
+{
+    std::vector<uint8_t> f(static_cast<size_t>(w) * h * 3);
+    for (int y = 0; y < h; y += 2)
+    {
+        for (int x = 0; x < w; x += 2)
+        {
+            const uint8_t c[3] = { static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()), static_cast<uint8_t>(rng()) };
+            for (int dy = 0; dy < 2; ++dy)
+                for (int dx = 0; dx < 2; ++dx)
+                    memcpy(&f[(static_cast<size_t>(y + dy) * w + x + dx) * 3], c, 3);
+        }
+    }
+    return f;
+}
+
+ConvertArgs MakeArgs(const uint8_t* src, int stride, int srcW, int srcH, uint8_t* dst, int w, int h)
+{
+    ConvertArgs a = {};
+    a.src = src;
+    a.srcStride = stride;
+    a.srcWidth = srcW;
+    a.srcHeight = srcH;
+    a.dst = dst;
+    a.width = w;
+    a.height = h;
+    return a;
+}
+
+// Ядро целиком и тремя полосами строк (границы чётные, как у StripePool)
+void RunStriped(ConvertFn fn, ConvertArgs a)
+{
+    const int third = (a.height / 3) & ~1;
+    const int bounds[] = { 0, third, 2 * third, a.height };
+    for (int i = 0; i < 3; ++i)
+    {
+        a.rowBegin = bounds[i];
+        a.rowEnd = bounds[i + 1];
+        if (a.rowBegin < a.rowEnd)
+            fn(a);
+    }
+}
+
+void CheckLegacy(std::mt19937& rng, CpuTier detected)
+{
+    const int sizes[][2] = { { 1920, 1080 }, { 1280, 720 }, { 640, 480 }, { 34, 6 }, { 1282, 10 }, { 66, 4 } };
+    for (const auto& s : sizes)
+    {
+        const int w = s[0], h = s[1];
+        const std::vector<uint8_t> src = BlockFrame(rng, w, h);
+        for (const Target& t : kTargets)
+        {
+            const size_t bytes = FrameBytes(t, w, h);
+            std::vector<uint8_t> want(bytes);
+            t.legacy(src.data(), want.data(), w, h, w, h);
+
+            AlignedBuffer got(bytes);
+            for (const Kernel& k : t.kernels)
+            {
+                if (k.tier > detected)
+                    continue;
+                memset(got.data, 0xCD, bytes);
+                ConvertArgs a = MakeArgs(src.data(), w * 3, w, h, got.data, w, h);
+                a.flipV = true;
+                k.fn(a);
+
+                char what[96];
+                snprintf(what, sizeof(what), "%s %s %dx%d против прежнего цикла", t.name, CpuTierName(k.tier), w, h);
+                Expect(what, got.data, want.data(), bytes);
+            }
+        }
+    }
+}
+
+void CheckTiers(std::mt19937& rng, CpuTier detected)
+{
+    // {srcW, srcH, outW, outH, лишние байты в строке источника}
+    const int cases[][5] =
+    {
+        { 1920, 1080, 1920, 1080, 0 },
+        { 1280, 720, 1280, 720, 16 },
+        { 640, 480, 640, 480, 0 },
+        { 34, 6, 34, 6, 0 },
+        { 1282, 10, 1282, 10, 5 },
+        { 1920, 1080, 1280, 720, 0 },
+        { 640, 360, 1280, 720, 0 },
+        { 1920, 1080, 34, 6, 0 },
+        { 333, 201, 96, 64, 3 },
+    };
+    ScaleTables tables;
+    for (const auto& c : cases)
+    {
+        const int srcW = c[0], srcH = c[1], w = c[2], h = c[3], stride = srcW * 3 + c[4];
+        const std::vector<uint8_t> src = RandomFrame(rng, srcH, stride);
+        tables.Build(srcW, srcH, w, h);
+        for (const Target& t : kTargets)
+        {
+            const size_t bytes = FrameBytes(t, w, h);
+            AlignedBuffer want(bytes), got(bytes);
+            for (int csi = 0; csi < static_cast<int>(ColorSpace::Count); ++csi)
+            {
+                for (int flip = 0; flip < 2; ++flip)
+                {
+                    ConvertArgs a = MakeArgs(src.data(), stride, srcW, srcH, want.data, w, h);
+                    a.colorSpace = static_cast<ColorSpace>(csi);
+                    a.flipV = flip != 0;
+                    a.store = StoreMode::Cached;
+                    t.kernels[0].fn(a);
+
+                    for (const Kernel& k : t.kernels)
+                    {
+                        if (k.tier > detected)
+                            continue;
+                        const StoreMode modes[] = { StoreMode::Cached, StoreMode::Streaming };
+                        for (StoreMode mode : modes)
+                        {
+                            ConvertArgs b = a;
+                            b.dst = got.data;
+                            b.store = mode;
+                            b.scale = mode == StoreMode::Streaming ? &tables : nullptr;
+
+                            char what[128];
+                            snprintf(what, sizeof(what), "%s %s %dx%d->%dx%d %s%s %s", t.name, CpuTierName(k.tier),
+                                     srcW, srcH, w, h, ColorSpaceName(a.colorSpace), flip ? " flip" : "",
+                                     mode == StoreMode::Streaming ? "streaming" : "cached");
+                            memset(got.data, 0xCD, bytes);
+                            k.fn(b);
+                            Expect(what, got.data, want.data, bytes);
+
+                            memset(got.data, 0xCD, bytes);
+                            RunStriped(k.fn, b);
+                            char striped[160];
+                            snprintf(striped, sizeof(striped), "%s по полосам", what);
+                            Expect(striped, got.data, want.data, bytes);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CheckYuvSources(std::mt19937& rng)
+{
+    const int w = 640, h = 480;
+    const std::vector<uint8_t> src = RandomFrame(rng, h, w * 3);
+    const size_t bytes420 = static_cast<size_t>(w) * h * 3 / 2;
+    std::vector<uint8_t> nv12(bytes420), i420(bytes420), yuy2(static_cast<size_t>(w) * h * 2), got(yuy2.size());
+
+    for (int csi = 0; csi < static_cast<int>(ColorSpace::Count); ++csi)
+    {
+        const ColorSpace cs = static_cast<ColorSpace>(csi);
+        ConvertArgs a = MakeArgs(src.data(), w * 3, w, h, nullptr, w, h);
+        a.colorSpace = cs;
+        a.dst = nv12.data();
+        ConvertBGR24ToNV12_Scalar(a);
+        a.dst = i420.data();
+        ConvertBGR24ToI420_Scalar(a);
+
+        struct Case { const char* name; ConvertFn fn; const std::vector<uint8_t>* in; const std::vector<uint8_t>* want; size_t bytes; };
+        const Case cases[] =
+        {
+            { "NV12->NV12", ConvertNV12ToNV12_Scalar, &nv12, &nv12, bytes420 },
+            { "NV12->I420", ConvertNV12ToI420_Scalar, &nv12, &i420, bytes420 },
+            { "I420->NV12", ConvertI420ToNV12_Scalar, &i420, &nv12, bytes420 },
+            { "I420->I420", ConvertI420ToI420_Scalar, &i420, &i420, bytes420 },
+        };
+        for (const Case& c : cases)
+        {
+            ConvertArgs b = MakeArgs(c.in->data(), w, w, h, got.data(), w, h);
+            b.colorSpace = cs;
+            b.srcColorSpace = cs;
+            memset(got.data(), 0xCD, c.bytes);
+            c.fn(b);
+
+            char what[96];
+            snprintf(what, sizeof(what), "%s %s", c.name, ColorSpaceName(cs));
+            Expect(what, got.data(), c.want->data(), c.bytes);
+        }
+
+        // Обе раскладки 4:2:0 дают одинаковый YUY2
+        ConvertArgs b = MakeArgs(nv12.data(), w, w, h, yuy2.data(), w, h);
+        b.colorSpace = cs;
+        b.srcColorSpace = cs;
+        ConvertNV12ToYUY2_Scalar(b);
+        b.src = i420.data();
+        b.dst = got.data();
+        ConvertI420ToYUY2_Scalar(b);
+
+        char what[96];
+        snprintf(what, sizeof(what), "I420->YUY2 против NV12->YUY2 %s", ColorSpaceName(cs));
+        Expect(what, got.data(), yuy2.data(), yuy2.size());
+    }
+}
+
+} // namespace
+
+int main()
+{
+    const CpuTier detected = DetectCpuTier();
+    printf("Процессор: %s\n", CpuTierName(detected));
+
+    std::mt19937 rng(1);
+    CheckLegacy(rng, detected);
+    CheckTiers(rng, detected);
+    CheckYuvSources(rng);
+
+    printf("%d проверок, %d расхождений\n", g_checks, g_failures);
+    return g_failures ? 1 : 0;
+}
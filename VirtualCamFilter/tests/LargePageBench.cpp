@@ -0,0 +1,221 @@
+// ----------------------------------------------------------------------------
+// Замер преобразования кадров прямо из слотов секции на обычных (4 КБ) и
+// больших (2 МБ) страницах. Секцию, как писатель, создаёт сам тест: обычную —
+// через POSIX shm, большую — через memfd_create(MFD_HUGETLB); это замена
+// SEC_LARGE_PAGES под Linux. Открывает её настоящий SharedMem из фильтра
+// (windows.h подменён tests/posix/windows.h): он просит вид с
+// FILE_MAP_LARGE_PAGES, и тест проверяет, что UsesLargePages() совпадает с
+// тем, как создана секция.
+//
+// Кадры BGR24 1920x1080 лежат в трёх слотах, каждое следующее преобразование
+// берёт следующий слот, как при живом писателе. Для каждого ядра — минимум
+// и медиана по прогонам, мкс на кадр. Выигрыш больших страниц — в промахах
+// TLB при чтении источника: 6 МБ кадра — полторы тысячи страниц по 4 КБ или
+// три по 2 МБ.
+//
+// Большие страницы надо зарезервировать заранее, иначе вторая половина
+// замера пропускается:
+//   echo 16 | sudo tee /proc/sys/vm/nr_hugepages
+// Если /sys/kernel/mm/transparent_hugepage/shmem_enabled не never, ядро
+// может подложить большие страницы и под обычную секцию — разница пропадёт.
+//
+// Сборка и запуск (Linux, x86-64, из каталога tests):
+//   S=../VirtualCamFilter
+//   g++ -O2 -std=c++17 -I$S -c $S/PixelConvert.cpp $S/PixelConvertYuv.cpp
+//   g++ -O2 -std=c++17 -mavx2 -I$S -c $S/PixelConvertAvx2.cpp
+//   g++ -O2 -std=c++17 -pthread -Iposix -I$S LargePageBench.cpp PixelConvert.o PixelConvertYuv.o PixelConvertAvx2.o -o large_page_bench -lrt
+//   ./large_page_bench
+// Код выхода 0 — SharedMem отобразил обе секции так, как они созданы.
+// ----------------------------------------------------------------------------
+
+#include "SharedMem.h"
+#include "PixelConvert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int    kWidth      = 1920;
+constexpr int    kHeight     = 1080;
+constexpr DWORD  kFrameSize  = kWidth * kHeight * 3;
+constexpr DWORD  kSlotCount  = SHM_MIN_SLOTS;
+constexpr DWORD  kSlotSize   = (kFrameSize + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+constexpr DWORD  kDataOffset = SHM_PAGE;
+constexpr size_t kLargePage  = static_cast<size_t>(2) << 20;
+
+// Секция, созданная «писателем»: дескриптор держим до конца замера
+struct Section
+{
+    int         fd = -1;
+    size_t      size = 0;
+    std::string name;   // g_shimShmName для SharedMem
+};
+
+bool CreateSection(bool large, Section& s)
+{
+    const size_t bytes = kDataOffset + static_cast<size_t>(kSlotCount) * kSlotSize;
+    if (large)
+    {
+        // Как TryCreateLargePageSection: размер кратен большой странице
+        s.size = (bytes + kLargePage - 1) / kLargePage * kLargePage;
+        s.fd = memfd_create("vcam-large", MFD_HUGETLB);
+        s.name = "/proc/self/fd/" + std::to_string(s.fd);
+    }
+    else
+    {
+        s.size = bytes;
+        s.name = "/vcam-bench-" + std::to_string(getpid());
+        s.fd = shm_open(s.name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    }
+    if (s.fd < 0 || ftruncate(s.fd, static_cast<off_t>(s.size)) != 0)
+    {
+        perror(large ? "memfd_create(MFD_HUGETLB)" : "shm_open");
+        return false;
+    }
+    return true;
+}
+
+void DestroySection(bool large, Section& s)
+{
+    if (s.fd >= 0)
+        close(s.fd);
+    if (!large)
+        shm_unlink(s.name.c_str());
+}
+
+// Заголовок, как у ConnectAsync писателя, и случайные кадры во всех слотах.
+// Для hugetlb страницы выделяются здесь же, при первой записи.
+bool FillSection(const Section& s)
+{
+    void* p = mmap(nullptr, s.size, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        return false;
+    }
+    SharedHeader* mem = static_cast<SharedHeader*>(p);
+    mem->version.store(0, std::memory_order_relaxed);
+    mem->magic.store(SHM_MAGIC, std::memory_order_relaxed);
+    mem->slotCount.store(kSlotCount, std::memory_order_relaxed);
+    mem->slotSize.store(kSlotSize, std::memory_order_relaxed);
+    mem->dataOffset.store(kDataOffset, std::memory_order_relaxed);
+    std::mt19937 rng(1);
+    BYTE* data = static_cast<BYTE*>(p) + kDataOffset;
+    for (size_t i = 0; i < static_cast<size_t>(kSlotCount) * kSlotSize; ++i)
+        data[i] = static_cast<BYTE>(rng());
+    mem->version.store(SHM_VERSION, std::memory_order_seq_cst);
+    munmap(p, s.size);
+    return true;
+}
+
+struct Stats
+{
+    double min, median;
+};
+
+template <class Fn>
+Stats Measure(Fn&& fn)
+{
+    constexpr int kRuns = 40;
+    constexpr int kFrames = 9;   // кратно числу слотов
+    std::vector<double> runs;
+    for (int r = 0; r < kRuns; ++r)
+    {
+        const auto t = Clock::now();
+        for (int i = 0; i < kFrames; ++i)
+            fn(static_cast<DWORD>(i) % kSlotCount);
+        runs.push_back(std::chrono::duration<double, std::micro>(Clock::now() - t).count() / kFrames);
+    }
+    std::sort(runs.begin(), runs.end());
+    return { runs.front(), runs[runs.size() / 2] };
+}
+
+// Один проход замера над уже созданной секцией. false — SharedMem отобразил
+// её не так, как она создана.
+bool RunBench(bool large, const Section& s)
+{
+    g_shimShmName = s.name.c_str();
+    SharedMem shm;
+    if (!shm.Connect() || shm.SlotCount() != kSlotCount)
+    {
+        fprintf(stderr, "SharedMem не открыл секцию %s\n", s.name.c_str());
+        return false;
+    }
+    const char* pages = large ? "2 МБ" : "4 КБ";
+    if (shm.UsesLargePages() != large)
+    {
+        fprintf(stderr, "%s: UsesLargePages() = %d, а секция %s\n", pages, shm.UsesLargePages(),
+                large ? "на больших страницах" : "на обычных страницах");
+        return false;
+    }
+
+    const SharedHeader* mem = shm.Get();
+    std::vector<uint8_t> dst(static_cast<size_t>(kWidth) * kHeight * 3);
+    struct Target { const char* name; PixelFormat fmt; int w, h; };
+    const Target targets[] =
+    {
+        { "NV12 1:1",    PixelFormat::NV12, kWidth, kHeight },
+        { "NV12 ->720p", PixelFormat::NV12, 1280, 720 },
+        { "YUY2 1:1",    PixelFormat::YUY2, kWidth, kHeight },
+    };
+    ScaleTables tables;
+    for (const Target& t : targets)
+    {
+        const ConvertFn fn = GetConverter(PixelFormat::BGR24, t.fmt);
+        tables.Build(kWidth, kHeight, t.w, t.h);
+        const Stats st = Measure([&](DWORD slot)
+        {
+            ConvertArgs a = {};
+            a.src = mem->Data(slot);
+            a.srcStride = kWidth * 3;
+            a.srcWidth = kWidth;
+            a.srcHeight = kHeight;
+            a.dst = dst.data();
+            a.width = t.w;
+            a.height = t.h;
+            a.flipV = true;
+            a.scale = &tables;
+            a.store = StoreMode::Cached;
+            fn(a);
+        });
+        printf("%s  %-14s %9.1f %9.1f\n", pages, t.name, st.min, st.median);
+    }
+    const Stats st = Measure([&](DWORD slot) { memcpy(dst.data(), mem->Data(slot), kFrameSize); });
+    printf("%s  %-14s %9.1f %9.1f\n", pages, "memcpy", st.min, st.median);
+    return true;
+}
+
+} // namespace
+
+int main()
+{
+    printf("Ядра: %s, кадр BGR24 %dx%d, слотов %u\n\n", CpuTierName(ActiveCpuTier()), kWidth, kHeight, kSlotCount);
+    printf("стр.  ядро            мин, мкс  мед., мкс\n");
+
+    bool ok = true;
+    for (const bool large : { false, true })
+    {
+        Section s;
+        if (!CreateSection(large, s) || !FillSection(s))
+        {
+            if (large)
+                printf("Больших страниц нет — зарезервируйте их через /proc/sys/vm/nr_hugepages\n");
+            else
+                ok = false;
+            DestroySection(large, s);
+            continue;
+        }
+        ok = RunBench(large, s) && ok;
+        DestroySection(large, s);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+// ----------------------------------------------------------------------------
+// Прежние циклы FillBuffer (до PixelConvert), перенесённые без изменений
+// арифметики: BGR24 bottom-up размером frameW x frameH -> выходной кадр
+// outW x outH, масштабирование выбором ближайшего пикселя, BT.601 16..235,
+// цветность — из левого верхнего пикселя блока. Эталон для KernelTest,
+// точка отсчёта для KernelBench и контроль порога ChromaQualityTest.
+// ----------------------------------------------------------------------------
+
+#include <cstddef>
+#include <cstdint>
+
+inline void LegacyBGR24ToNV12(const uint8_t* frameData, uint8_t* pData, int frameW, int frameH, int outW, int outH)
+{
+    uint8_t* yPlane = pData;
+    uint8_t* uvPlane = pData + outW * outH;
+    for (int y = 0; y < outH; ++y)
+    {
+        const int srcY = frameH - 1 - (y * frameH) / outH;
+        const uint8_t* line = frameData + srcY * frameW * 3;
+        for (int x = 0; x < outW; ++x)
+        {
+            const int srcX = (x * frameW) / outW;
+            const uint8_t B = line[srcX * 3];
+            const uint8_t G = line[srcX * 3 + 1];
+            const uint8_t R = line[srcX * 3 + 2];
+
+            const int Y = (66 * R + 129 * G + 25 * B + 128) >> 8;
+            yPlane[y * outW + x] = static_cast<uint8_t>(Y + 16);
+            if ((y % 2) == 0 && (x % 2) == 0)
+            {
+                const int U = (-38 * R - 74 * G + 112 * B + 128) >> 8;
+                const int V = (112 * R - 94 * G - 18 * B + 128) >> 8;
+                uvPlane[(y / 2) * outW + x] = static_cast<uint8_t>(U + 128);
+                uvPlane[(y / 2) * outW + x + 1] = static_cast<uint8_t>(V + 128);
+            }
+        }
+    }
+}
+
+inline void LegacyBGR24ToI420(const uint8_t* frameData, uint8_t* pData, int frameW, int frameH, int outW, int outH)
+{
+    uint8_t* yPlane = pData;
+    uint8_t* uPlane = pData + outW * outH;
+    uint8_t* vPlane = uPlane + (outW * outH) / 4;
+    for (int y = 0; y < outH; ++y)
+    {
+        const int srcY = frameH - 1 - (y * frameH) / outH;
+        const uint8_t* line = frameData + srcY * frameW * 3;
+        for (int x = 0; x < outW; ++x)
+        {
+            const int srcX = (x * frameW) / outW;
+            const uint8_t B = line[srcX * 3];
+            const uint8_t G = line[srcX * 3 + 1];
+            const uint8_t R = line[srcX * 3 + 2];
+
+            const int Y = (66 * R + 129 * G + 25 * B + 128) >> 8;
+            yPlane[y * outW + x] = static_cast<uint8_t>(Y + 16);
+            if ((y % 2) == 0 && (x % 2) == 0)
+            {
+                const int U = (-38 * R - 74 * G + 112 * B + 128) >> 8;
+                const int V = (112 * R - 94 * G - 18 * B + 128) >> 8;
+                const size_t uvIndex = (y / 2) * (outW / 2) + (x / 2);
+                uPlane[uvIndex] = static_cast<uint8_t>(U + 128);
+                vPlane[uvIndex] = static_cast<uint8_t>(V + 128);
+            }
+        }
+    }
+}
+
+inline void LegacyBGR24ToYUY2(const uint8_t* frameData, uint8_t* pData, int frameW, int frameH, int outW, int outH)
+{
+    const auto RGB2Y = [](int R, int G, int B) { return static_cast<uint8_t>(((66 * R + 129 * G + 25 * B + 128) >> 8) + 16); };
+    const auto RGB2U = [](int R, int G, int B) { return static_cast<uint8_t>(((-38 * R - 74 * G + 112 * B + 128) >> 8) + 128); };
+    const auto RGB2V = [](int R, int G, int B) { return static_cast<uint8_t>(((112 * R - 94 * G - 18 * B + 128) >> 8) + 128); };
+
+    uint8_t* dst = pData;
+    for (int y = 0; y < outH; ++y)
+    {
+        const int srcY = frameH - 1 - (y * frameH) / outH;
+        const uint8_t* line = frameData + srcY * frameW * 3;
+        for (int x = 0; x < outW; x += 2)
+        {
+            const int srcX1 = (x * frameW) / outW;
+            const int srcX2 = ((x + 1) * frameW) / outW;
+            const uint8_t B1 = line[srcX1 * 3], G1 = line[srcX1 * 3 + 1], R1 = line[srcX1 * 3 + 2];
+            const uint8_t B2 = line[srcX2 * 3], G2 = line[srcX2 * 3 + 1], R2 = line[srcX2 * 3 + 2];
+            *dst++ = RGB2Y(R1, G1, B1);
+            *dst++ = RGB2U(R1, G1, B1);
+            *dst++ = RGB2Y(R2, G2, B2);
+            *dst++ = RGB2V(R1, G1, B1);
+        }
+    }
+}
@@ -0,0 +1,426 @@
+// ----------------------------------------------------------------------------
+// Стресс-тест протокола разделяемой памяти: один писатель и несколько
+// процессов-читателей над одной секцией POSIX shm. Читатели — настоящий
+// SharedMem из фильтра (windows.h подменён tests/posix/windows.h), писатель
+// повторяет PublishFrame/AcquireFreeSlot из VirtualCameraSharedMemClient.cs
+// с той же раскладкой SharedHeader.
+//
+// Каждый кадр заполнен байтом, выведенным из его frameId, поэтому читатель
+// по копии кадра видит, смешались ли в ней два кадра. Проверяется:
+//   - ReadFrame с результатом Ok никогда не отдаёт смешанный кадр;
+//   - слот, закреплённый PinLatest, писатель не трогает, пока его не отпустят;
+//   - frameId у читателя не убывает;
+//   - после выхода читателей все счётчики readers нулевые, записи таблицы
+//     читателей свободны;
+//   - писатель открыл событие кадра каждого читателя по pid и номеру записи
+//     (в шиме это futex в общей памяти) и будит их им, а не таймаутом.
+// Вторая фаза — писатель, не смотрящий на readers (как при возврате слотов
+// мёртвого процесса): смешанные кадры возможны, но ReadFrame обязан вернуть
+// для них Torn, а не Ok. Чтобы гонка случалась и на одном ядре, читатель в
+// этой фазе через раз засыпает посреди копирования кадра.
+//
+// Сборка и запуск (Linux, из каталога tests):
+//   g++ -O2 -std=c++17 -pthread -Iposix -I../VirtualCamFilter ShmStressTest.cpp -o shm_stress -lrt
+//   ./shm_stress [секунд на фазу] [читателей]
+// Код выхода 0 — ошибок нет.
+// ----------------------------------------------------------------------------
+
+#include "SharedMem.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+
+namespace {
+
+constexpr int   kWidth    = 640;
+constexpr int   kHeight   = 480;
+constexpr DWORD kFrameSize = kWidth * kHeight * 3;
+constexpr DWORD kSlotCount = SHM_MIN_SLOTS;    // меньше всего свободных слотов — больше всего гонок
+constexpr DWORD kSlotSize  = (kFrameSize + SHM_PAGE - 1) / SHM_PAGE * SHM_PAGE;
+constexpr DWORD kDataOffset = SHM_PAGE;
+constexpr size_t kSectionSize = kDataOffset + static_cast<size_t>(kSlotCount) * kSlotSize;
+
+BYTE PatternByte(LONG frameId) { return static_cast<BYTE>(frameId * 131 + 7); }
+
+// Первые и последние 4 байта — сам frameId, остальное — PatternByte
+void FillFrame(BYTE* dst, LONG frameId)
+{
+    memset(dst, PatternByte(frameId), kFrameSize);
+    memcpy(dst, &frameId, sizeof(frameId));
+    memcpy(dst + kFrameSize - sizeof(frameId), &frameId, sizeof(frameId));
+}
+
+bool CheckFrame(const BYTE* src, LONG frameId)
+{
+    LONG head = 0, tail = 0;
+    memcpy(&head, src, sizeof(head));
+    memcpy(&tail, src + kFrameSize - sizeof(tail), sizeof(tail));
+    if (head != frameId || tail != frameId)
+        return false;
+    const BYTE b = PatternByte(frameId);
+    for (DWORD i = sizeof(LONG); i < kFrameSize - sizeof(LONG); ++i)
+    {
+        if (src[i] != b)
+            return false;
+    }
+    return true;
+}
+
+// ----------------------------------------------------------------------------
+// Писатель
+// ----------------------------------------------------------------------------
+class Writer
+{
+public:
+    explicit Writer(SharedHeader* mem) : m_mem(mem)
+    {
+        // Как ConnectAsync писателя: version пишется последним
+        m_mem->version.store(0, std::memory_order_relaxed);
+        m_mem->magic.store(SHM_MAGIC, std::memory_order_relaxed);
+        m_mem->slotCount.store(kSlotCount, std::memory_order_relaxed);
+        m_mem->slotSize.store(kSlotSize, std::memory_order_relaxed);
+        m_mem->dataOffset.store(kDataOffset, std::memory_order_relaxed);
+        m_mem->frameId.store(0, std::memory_order_relaxed);
+        m_mem->currentBuffer.store(0, std::memory_order_relaxed);
+        for (DWORD i = 0; i < kSlotCount; ++i)
+        {
+            m_mem->slots[i].seq.store(0, std::memory_order_relaxed);
+            m_mem->slots[i].frameId.store(0, std::memory_order_relaxed);
+            m_mem->slots[i].fourcc.store(0, std::memory_order_relaxed);
+        }
+        m_mem->version.store(SHM_VERSION, std::memory_order_seq_cst);
+    }
+
+    // Кладёт кадр в свободный слот и публикует его. false — все слоты заняты.
+    bool Publish(bool ignoreReaders)
+    {
+        const int current = m_mem->currentBuffer.load(std::memory_order_relaxed);
+        LONG seq = 0;
+        const int slot = AcquireFreeSlot(current, ignoreReaders, &seq);
+        if (slot < 0)
+        {
+            ++m_dropped;
+            return false;
+        }
+
+        SharedSlot& s = m_mem->slots[slot];
+        const LONG frameId = ++m_frameId;
+        FillFrame(const_cast<BYTE*>(m_mem->Data(slot)), frameId);
+        s.fourcc.store(SHM_FOURCC_BGR24, std::memory_order_relaxed);
+        s.width.store(kWidth, std::memory_order_relaxed);
+        s.height.store(kHeight, std::memory_order_relaxed);
+        s.stride.store(kWidth * 3, std::memory_order_relaxed);
+        s.size.store(kFrameSize, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        s.frameId.store(frameId, std::memory_order_relaxed);
+
+        s.seq.store(seq + 2, std::memory_order_seq_cst);
+        m_mem->currentBuffer.store(slot, std::memory_order_seq_cst);
+        m_mem->frameId.store(frameId, std::memory_order_seq_cst);
+        ++m_published;
+        SignalReaders();
+        return true;
+    }
+
+    ~Writer()
+    {
+        for (HANDLE ev : m_events)
+        {
+            if (ev)
+                CloseHandle(ev);
+        }
+    }
+
+    LONG Published() const { return m_published; }
+    LONG EventsOpened() const { return m_eventsOpened; }
+    LONG Dropped() const { return m_dropped; }
+
+private:
+    // Как SignalReaders писателя: событие записи открывается один раз на pid.
+    // Неудача запоминается вместе с тем, был ли у записи heartbeat, и
+    // повторяется, только когда запись освободят или займут заново.
+    void SignalReaders()
+    {
+        for (DWORD i = 0; i < SHM_MAX_READERS; ++i)
+        {
+            const SharedReader& r = m_mem->readerTable[i];
+            const DWORD pid = r.pid.load(std::memory_order_acquire);
+            const bool live = r.heartbeat.load(std::memory_order_acquire) != 0;
+            if (pid == 0)
+            {
+                ForgetEvent(i);
+                continue;
+            }
+            if (m_events[i] && m_eventPids[i] == pid)
+            {
+                SetEvent(m_events[i]);
+                continue;
+            }
+            if (m_eventFailed[i] && m_eventPids[i] == pid && m_eventFailedLive[i] == live)
+                continue;
+
+            ForgetEvent(i);
+            wchar_t name[64];
+            swprintf_s(name, _countof(name), VCAM_EVENT_FORMAT, static_cast<unsigned long>(pid), static_cast<int>(i));
+            m_events[i] = OpenEventW(EVENT_MODIFY_STATE, FALSE, name);
+            m_eventPids[i] = pid;
+            m_eventFailed[i] = m_events[i] == nullptr;
+            m_eventFailedLive[i] = live;
+            if (m_events[i])
+            {
+                ++m_eventsOpened;
+                SetEvent(m_events[i]);
+            }
+        }
+    }
+
+    void ForgetEvent(DWORD i)
+    {
+        if (m_events[i])
+            CloseHandle(m_events[i]);
+        m_events[i] = nullptr;
+        m_eventPids[i] = 0;
+        m_eventFailed[i] = false;
+    }
+
+    // Схема Деккера, парная к ReadFrame: seq нечётный, затем повторная
+    // проверка readers. ignoreReaders пишет в следующий слот не глядя.
+    int AcquireFreeSlot(int current, bool ignoreReaders, LONG* seqOut)
+    {
+        for (DWORD k = 1; k < kSlotCount; ++k)
+        {
+            const int candidate = static_cast<int>((current + k) % kSlotCount);
+            SharedSlot& s = m_mem->slots[candidate];
+            if (!ignoreReaders && s.readers.load(std::memory_order_seq_cst) != 0)
+                continue;
+
+            LONG seq = s.seq.load(std::memory_order_relaxed);
+            if (seq & 1)
+                ++seq; // прошлая запись оборвалась посередине
+            s.seq.store(seq + 1, std::memory_order_seq_cst);
+            if (!ignoreReaders && s.readers.load(std::memory_order_seq_cst) != 0)
+            {
+                s.seq.store(seq, std::memory_order_seq_cst);   // данные не менялись
+                continue;
+            }
+            *seqOut = seq;
+            return candidate;
+        }
+        return -1;
+    }
+
+    SharedHeader* m_mem;
+    LONG m_frameId   = 0;
+    LONG m_published = 0;
+    HANDLE m_events[SHM_MAX_READERS] = {};
+    DWORD  m_eventPids[SHM_MAX_READERS] = {};
+    bool   m_eventFailed[SHM_MAX_READERS] = {};
+    bool   m_eventFailedLive[SHM_MAX_READERS] = {};
+    LONG   m_eventsOpened = 0;
+    LONG m_dropped   = 0;
+};
+
+// ----------------------------------------------------------------------------
+// Читатель (дочерний процесс)
+// ----------------------------------------------------------------------------
+struct ReaderStats
+{
+    long ok = 0, torn = 0, noFrame = 0, pinned = 0, errors = 0;
+};
+
+int RunReader(int index, ULONGLONG deadline, bool writerIgnoresReaders)
+{
+    SharedMem shm;
+    shm.Connect();
+    while (!shm.SlotCount() && GetTickCount64() < deadline)
+        Sleep(1);
+    if (!shm.SlotCount() || !shm.IsWritable())
+    {
+        fprintf(stderr, "reader %d: секция не открылась\n", index);
+        return 2;
+    }
+    shm.SetDemand(SHM_FOURCC_BGR24, kWidth, kHeight);
+    shm.SetStreaming(true);
+
+    std::vector<BYTE> copy(kFrameSize);
+    ReaderStats st;
+    LONG lastId = 0;
+    unsigned rng = 12345u + static_cast<unsigned>(index) * 7919u;
+    while (GetTickCount64() < deadline)
+    {
+        shm.WaitForNewFrame(lastId, 20);
+
+        rng = rng * 1103515245u + 12345u;
+        const bool stall = writerIgnoresReaders && (rng >> 16) % 2 == 0;
+        LONG frameId = -1;
+        const FrameRead read = shm.ReadFrame([&](const SharedFrame& f)
+        {
+            frameId = f.frameId;
+            if (f.size != kFrameSize)
+                return;
+            memcpy(copy.data(), f.data, kFrameSize / 2);
+            if (stall)
+                usleep(500); // писатель успеет перезаписать слот
+            memcpy(copy.data() + kFrameSize / 2, f.data + kFrameSize / 2, kFrameSize - kFrameSize / 2);
+        });
+        if (read == FrameRead::Ok)
+        {
+            ++st.ok;
+            if (!CheckFrame(copy.data(), frameId))
+            {
+                ++st.errors;
+                fprintf(stderr, "reader %d: кадр %d смешан, но ReadFrame вернул Ok\n", index, frameId);
+            }
+            if (frameId < lastId)
+            {
+                ++st.errors;
+                fprintf(stderr, "reader %d: frameId убыл: %d после %d\n", index, frameId, lastId);
+            }
+            lastId = frameId;
+        }
+        else if (read == FrameRead::Torn)
+            ++st.torn;
+        else
+            ++st.noFrame;
+
+        // Каждый четвёртый раз держим слот, как семпл без копирования у
+        // приёмника, и проверяем, что писатель его не тронул
+        rng = rng * 1103515245u + 12345u;
+        if (!writerIgnoresReaders && (rng >> 16) % 4 == 0)
+        {
+            SharedFrame f;
+            const int slot = shm.PinLatest(&f);
+            if (slot >= 0)
+            {
+                ++st.pinned;
+                usleep(200 + (rng >> 20) % 2000);
+                if (!CheckFrame(f.data, f.frameId))
+                {
+                    ++st.errors;
+                    fprintf(stderr, "reader %d: писатель перезаписал закреплённый слот %d (кадр %d)\n",
+                            index, slot, f.frameId);
+                }
+                shm.Unpin(slot);
+            }
+        }
+        shm.UpdateReader(lastId);
+    }
+    shm.SetStreaming(false);
+
+    printf("  reader %d: ok %ld, torn %ld, нет кадра %ld, закреплений %ld, ошибок %ld\n",
+           index, st.ok, st.torn, st.noFrame, st.pinned, st.errors);
+    fflush(stdout);
+    // Во второй фазе сама проверка ничего не стоит, если Torn не было ни разу
+    if (writerIgnoresReaders && st.torn == 0)
+    {
+        fprintf(stderr, "reader %d: ни одного оборванного чтения — гонка не воспроизвелась\n", index);
+        return 1;
+    }
+    return st.errors == 0 && st.ok > 0 ? 0 : 1;
+}
+
+// Одна фаза: писатель в этом процессе, читатели — дочерние процессы
+bool RunPhase(const char* name, SharedHeader* mem, int readers, DWORD seconds, bool ignoreReaders)
+{
+    printf("%s: %d читателей, %u с, слотов %u\n", name, readers, seconds, kSlotCount);
+    fflush(stdout);
+
+    Writer writer(mem);
+    const ULONGLONG deadline = GetTickCount64() + seconds * 1000ull;
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < readers; ++i)
+    {
+        const pid_t pid = fork();
+        if (pid == 0)
+            _exit(RunReader(i, deadline, ignoreReaders));
+        if (pid < 0)
+        {
+            perror("fork");
+            return false;
+        }
+        children.push_back(pid);
+    }
+
+    // Публикуем без пауз: чем чаще перезапись, тем больше гонок
+    while (GetTickCount64() < deadline + 100)
+        writer.Publish(ignoreReaders);
+
+    bool ok = true;
+    for (pid_t pid : children)
+    {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = false;
+    }
+
+    // Читатели вышли — ни один слот не должен остаться закреплённым
+    for (DWORD i = 0; i < kSlotCount; ++i)
+    {
+        const LONG r = mem->slots[i].readers.load(std::memory_order_acquire);
+        if (r != 0)
+        {
+            fprintf(stderr, "%s: слот %u остался с readers=%d\n", name, i, r);
+            ok = false;
+        }
+    }
+    for (DWORD i = 0; i < SHM_MAX_READERS; ++i)
+    {
+        if (mem->readerTable[i].pid.load(std::memory_order_acquire) != 0)
+        {
+            fprintf(stderr, "%s: запись читателя %u не освобождена\n", name, i);
+            ok = false;
+        }
+    }
+
+    // Каждый читатель занимает одну запись и создаёт одно событие
+    if (writer.EventsOpened() != readers)
+    {
+        fprintf(stderr, "%s: открыто событий читателей %d из %d\n", name, writer.EventsOpened(), readers);
+        ok = false;
+    }
+
+    printf("%s: опубликовано %d, пропущено (все слоты заняты) %d, событий читателей %d — %s\n",
+           name, writer.Published(), writer.Dropped(), writer.EventsOpened(), ok ? "OK" : "ОШИБКА");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const DWORD seconds = argc > 1 ? static_cast<DWORD>(atoi(argv[1])) : 3;
+    const int readers   = argc > 2 ? atoi(argv[2]) : 4;
+
+    static std::string name = "/vcam-test-" + std::to_string(getpid());
+    g_shimShmName = name.c_str();
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(kSectionSize)) != 0)
+    {
+        perror("shm_open");
+        return 2;
+    }
+    void* p = mmap(nullptr, kSectionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        shm_unlink(name.c_str());
+        return 2;
+    }
+    SharedHeader* mem = static_cast<SharedHeader*>(p);
+
+    bool ok = RunPhase("Фаза 1 (писатель обходит занятые слоты)", mem, readers, seconds, false);
+    ok = RunPhase("Фаза 2 (писатель не смотрит на readers)", mem, readers, seconds, true) && ok;
+
+    munmap(p, kSectionSize);
+    shm_unlink(name.c_str());
+    printf(ok ? "Все проверки пройдены\n" : "Есть ошибки\n");
+    return ok ? 0 : 1;
+}
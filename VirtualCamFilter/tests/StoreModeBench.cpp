@@ -0,0 +1,157 @@
+// ----------------------------------------------------------------------------
+// Замер записи выходного кадра через кэш (StoreMode::Cached) и в обход него
+// (StoreMode::Streaming) для кадров от QVGA до 1440p — проверка порога
+// StreamingStoreThreshold() (объём кэша последнего уровня), по которому
+// выбирает StoreMode::Auto.
+//
+// Для каждого размера и режима — лучшее из нескольких прогонов, мкс на кадр:
+//   convert   — само преобразование BGR24 -> NV12 / YUY2;
+//   ws-reread — затем чтение «рабочего набора приложения» в половину L2,
+//               прогретого до преобразования: сколько стоит то, что кадр
+//               вытеснил его из кэша;
+//   readback  — затем чтение выходного кадра целиком, как это сделал бы
+//               приёмник сразу после FillBuffer на том же ядре.
+// Streaming оправдан там, где convert у него не медленнее, а readback всё
+// равно не из кэша. На Xeon с L2 2 МБ и L3 105 МБ до 1080p включительно
+// convert у режимов одинаков и за L2, а readback после Streaming в 2-2.5
+// раза дольше: кадр, не влезший в L2, получатель читает из L3. На 1440p
+// Streaming на 10% быстрее в convert, но readback съедает почти весь
+// выигрыш. Поэтому порог — LLC, а не L2. Сравнивать стоит на том железе,
+// где работает фильтр.
+//
+// Сборка и запуск (Linux, x86-64, из каталога tests):
+//   S=../VirtualCamFilter
+//   g++ -O2 -std=c++17 -I$S -c $S/PixelConvert.cpp $S/PixelConvertYuv.cpp
+//   g++ -O2 -std=c++17 -mavx2 -I$S -c $S/PixelConvertAvx2.cpp
+//   g++ -O2 -std=c++17 -I$S StoreModeBench.cpp PixelConvert.o PixelConvertYuv.o PixelConvertAvx2.o -o store_bench
+//   ./store_bench
+// ----------------------------------------------------------------------------
+
+#include "PixelConvert.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double Micros(Clock::time_point from)
+{
+    return std::chrono::duration<double, std::micro>(Clock::now() - from).count();
+}
+
+// Сумма по строкам кэша — чтение без лишней арифметики
+uint64_t TouchLines(const uint8_t* p, size_t bytes)
+{
+    uint64_t sum = 0;
+    for (size_t i = 0; i < bytes; i += 64)
+        sum += p[i];
+    return sum;
+}
+
+struct Result
+{
+    double convert, wsReread, readback;
+};
+
+// Объём L2 — для рабочего набора; 1 МБ, если не узнали
+size_t L2CacheSize()
+{
+    const long size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return size > 0 ? static_cast<size_t>(size) : static_cast<size_t>(1) << 20;
+}
+
+Result Measure(ConvertFn fn, const ConvertArgs& a, size_t frameBytes, const std::vector<uint8_t>& ws)
+{
+    constexpr int kRuns = 15;
+    constexpr int kFrames = 8;
+    Result best = { 1e12, 1e12, 1e12 };
+    volatile uint64_t sink = 0;
+    for (int r = 0; r < kRuns; ++r)
+    {
+        double convert = 0, reread = 0, readback = 0;
+        for (int i = 0; i < kFrames; ++i)
+        {
+            sink = sink + TouchLines(ws.data(), ws.size());   // прогреваем рабочий набор
+
+            auto t = Clock::now();
+            fn(a);
+            convert += Micros(t);
+
+            t = Clock::now();
+            sink = sink + TouchLines(ws.data(), ws.size());
+            reread += Micros(t);
+
+            fn(a);
+            t = Clock::now();
+            sink = sink + TouchLines(a.dst, frameBytes);
+            readback += Micros(t);
+        }
+        best.convert  = std::min(best.convert, convert / kFrames);
+        best.wsReread = std::min(best.wsReread, reread / kFrames);
+        best.readback = std::min(best.readback, readback / kFrames);
+    }
+    return best;
+}
+
+} // namespace
+
+int main()
+{
+    const size_t threshold = StreamingStoreThreshold();
+    const size_t l2 = L2CacheSize();
+    printf("Ядра: %s, L2: %zu КБ, порог Auto (LLC): %zu КБ\n\n", CpuTierName(ActiveCpuTier()), l2 / 1024,
+           threshold == SIZE_MAX ? 0 : threshold / 1024);
+
+    struct Size { int w, h; };
+    const Size sizes[] = { {320,240}, {480,272}, {640,360}, {640,480}, {960,540}, {1280,720}, {1920,1080}, {2560,1440} };
+    struct Target { const char* name; PixelFormat fmt; int num, den; };
+    const Target targets[] = { {"NV12", PixelFormat::NV12, 3, 2}, {"YUY2", PixelFormat::YUY2, 2, 1} };
+
+    std::mt19937 rng(1);
+    std::vector<uint8_t> ws(l2 / 2);
+    for (auto& v : ws)
+        v = static_cast<uint8_t>(rng());
+
+    printf("кадр       выход       КБ |  convert cached / strm | ws-reread cached / strm | readback cached / strm\n");
+    for (const Size& s : sizes)
+    {
+        std::vector<uint8_t> src(static_cast<size_t>(s.w) * s.h * 3);
+        for (auto& v : src)
+            v = static_cast<uint8_t>(rng());
+        uint8_t* dst = static_cast<uint8_t*>(aligned_alloc(64, static_cast<size_t>(s.w) * s.h * 2 + 64));
+
+        for (const Target& t : targets)
+        {
+            const ConvertFn fn = GetConverter(PixelFormat::BGR24, t.fmt);
+            const size_t frameBytes = static_cast<size_t>(s.w) * s.h * t.num / t.den;
+            ConvertArgs a = {};
+            a.src = src.data();
+            a.srcStride = s.w * 3;
+            a.srcWidth = s.w;
+            a.srcHeight = s.h;
+            a.dst = dst;
+            a.width = s.w;
+            a.height = s.h;
+
+            a.store = StoreMode::Cached;
+            const Result c = Measure(fn, a, frameBytes, ws);
+            a.store = StoreMode::Streaming;
+            const Result n = Measure(fn, a, frameBytes, ws);
+
+            printf("%4dx%-5d %-5s %8zu | %9.1f / %9.1f | %9.1f / %9.1f | %9.1f / %9.1f  %s\n",
+                   s.w, s.h, t.name, frameBytes / 1024,
+                   c.convert, n.convert, c.wsReread, n.wsReread, c.readback, n.readback,
+                   frameBytes > threshold ? "Auto: streaming" : "Auto: cached");
+        }
+        free(dst);
+    }
+    return 0;
+}
@@ -0,0 +1,387 @@
+#pragma once
+
+// ----------------------------------------------------------------------------
+// Минимальная замена <windows.h> для тестов под Linux: ровно то, что нужно
+// SharedMem.h и тестам. Секция — POSIX shm (shm_open + mmap), поток —
+// pthread, событие — мьютекс с условной переменной. Именованное событие
+// (событие кадра читателя) — futex в своём объекте POSIX shm, его видят все
+// процессы: только auto-reset, имя живёт, пока его не закроет создатель.
+//
+// Имя секции VCAM_SHM_NAME здесь не используется: тест задаёт POSIX-имя в
+// g_shimShmName до fork, дочерние процессы наследуют его. Имя, начинающееся
+// с "/proc/" или "/dev/", — путь к файлу, он открывается open(): так секцию
+// на больших страницах (memfd_create с MFD_HUGETLB, /proc/<pid>/fd/<n>, или
+// файл на hugetlbfs) видно как секцию SEC_LARGE_PAGES. FILE_MAP_LARGE_PAGES
+// MapViewOfFile принимает только для такого файла, как и Windows — только
+// для секции на больших страницах.
+// ----------------------------------------------------------------------------
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdarg>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <cwchar>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <linux/magic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef uint32_t DWORD;
+typedef int32_t  LONG;
+typedef uint64_t ULONGLONG;
+typedef uint8_t  BYTE;
+typedef int      BOOL;
+typedef void*    LPVOID;
+typedef const void* LPCVOID;
+typedef void*    HANDLE;
+
+#define WINAPI
+#define TRUE  1
+#define FALSE 0
+#define INFINITE      0xFFFFFFFFu
+#define WAIT_OBJECT_0 0u
+#define WAIT_TIMEOUT  258u
+#define FILE_MAP_WRITE 0x0002u
+#define FILE_MAP_READ  0x0004u
+#define FILE_MAP_LARGE_PAGES 0x20000000u
+#define EVENT_MODIFY_STATE 0x0002u
+#define SYNCHRONIZE        0x00100000u
+#ifndef _countof
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+inline const char* g_shimShmName = "/vcam-test";
+
+struct MEMORY_BASIC_INFORMATION
+{
+    void*  BaseAddress;
+    size_t RegionSize;
+};
+
+namespace shim {
+
+enum class Kind { Mapping, Event, Thread };
+
+struct Handle
+{
+    Kind kind;
+    // Mapping
+    int fd = -1;
+    // Event
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t  cond  = PTHREAD_COND_INITIALIZER;
+    bool manualReset = false;
+    bool signaled    = false;
+    // Именованное событие: слово futex в общей памяти (1 — взведено)
+    std::atomic<uint32_t>* word = nullptr;
+    char shmName[96] = {};
+    bool owner = false; // создатель удаляет имя при закрытии
+    // Thread
+    pthread_t thread = {};
+    DWORD (*proc)(LPVOID) = nullptr;
+    LPVOID param = nullptr;
+    bool finished = false;
+};
+
+// Отображения процесса: SharedMem держит одно, тесту хватает нескольких
+struct View { void* base; size_t size; };
+inline View g_views[16];
+
+inline void* ThreadEntry(void* p)
+{
+    Handle* h = static_cast<Handle*>(p);
+    h->proc(h->param);
+    pthread_mutex_lock(&h->mutex);
+    h->finished = true;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->mutex);
+    return nullptr;
+}
+
+inline timespec Deadline(DWORD ms)
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec  += ms / 1000;
+    ts.tv_nsec += static_cast<long>(ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+// Имя объекта shm для имени события: Global\vCamFrameEvent.1.0 ->
+// /vcam-ev-Global_vCamFrameEvent.1.0
+inline bool EventShmName(const wchar_t* name, char* out, size_t size)
+{
+    const char prefix[] = "/vcam-ev-";
+    size_t n = sizeof(prefix) - 1;
+    memcpy(out, prefix, n);
+    for (; *name; ++name)
+    {
+        if (n + 1 >= size || *name > 0x7F)
+            return false;
+        out[n++] = *name == L'\\' || *name == L'/' ? '_' : static_cast<char>(*name);
+    }
+    out[n] = 0;
+    return true;
+}
+
+inline Handle* MapNamedEvent(const wchar_t* name, bool create)
+{
+    char shmName[96];
+    if (!EventShmName(name, shmName, sizeof(shmName)))
+        return nullptr;
+    const int fd = shm_open(shmName, O_RDWR | (create ? O_CREAT : 0), 0600);
+    if (fd < 0)
+        return nullptr;
+    void* p = MAP_FAILED;
+    if (!create || ftruncate(fd, sizeof(uint32_t)) == 0)
+        p = mmap(nullptr, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return nullptr;
+    Handle* h = new Handle{ Kind::Event };
+    h->word = static_cast<std::atomic<uint32_t>*>(p);
+    h->owner = create;
+    memcpy(h->shmName, shmName, sizeof(shmName));
+    return h;
+}
+
+// Ожидание именованного события: забираем взведённое слово, иначе спим на
+// futex, пока SetEvent не разбудит или не выйдет время
+inline bool WaitNamedEvent(Handle* h, DWORD ms)
+{
+    const timespec deadline = Deadline(ms == INFINITE ? 0 : ms);
+    for (;;)
+    {
+        uint32_t expected = 1;
+        if (h->word->compare_exchange_strong(expected, 0))
+            return true;
+
+        timespec rel = {}, *timeout = nullptr;
+        if (ms != INFINITE)
+        {
+            timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            const long long ns = (deadline.tv_sec - now.tv_sec) * 1000000000LL + (deadline.tv_nsec - now.tv_nsec);
+            if (ns <= 0)
+                return false;
+            rel.tv_sec  = static_cast<time_t>(ns / 1000000000LL);
+            rel.tv_nsec = static_cast<long>(ns % 1000000000LL);
+            timeout = &rel;
+        }
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(h->word), FUTEX_WAIT, 0u, timeout, nullptr, 0);
+    }
+}
+
+} // namespace shim
+
+inline ULONGLONG GetTickCount64()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<ULONGLONG>(ts.tv_sec) * 1000u + static_cast<ULONGLONG>(ts.tv_nsec) / 1000000u;
+}
+
+inline DWORD GetCurrentProcessId() { return static_cast<DWORD>(getpid()); }
+
+inline void Sleep(DWORD ms) { usleep(static_cast<useconds_t>(ms) * 1000u); }
+
+inline HANDLE OpenFileMappingW(DWORD access, BOOL, const wchar_t*)
+{
+    const int flags = (access & FILE_MAP_WRITE) ? O_RDWR : O_RDONLY;
+    const bool path = strncmp(g_shimShmName, "/proc/", 6) == 0 || strncmp(g_shimShmName, "/dev/", 5) == 0;
+    const int fd = path ? open(g_shimShmName, flags) : shm_open(g_shimShmName, flags, 0);
+    if (fd < 0)
+        return nullptr;
+    shim::Handle* h = new shim::Handle{ shim::Kind::Mapping };
+    h->fd = fd;
+    return h;
+}
+
+inline LPVOID MapViewOfFile(HANDLE map, DWORD access, DWORD, DWORD, size_t bytes)
+{
+    shim::Handle* h = static_cast<shim::Handle*>(map);
+    if (!h || h->kind != shim::Kind::Mapping || (access & ~(FILE_MAP_READ | FILE_MAP_WRITE | FILE_MAP_LARGE_PAGES)))
+        return nullptr;
+    if (access & FILE_MAP_LARGE_PAGES)
+    {
+        struct statfs fs;
+        if (fstatfs(h->fd, &fs) != 0 || fs.f_type != HUGETLBFS_MAGIC)
+            return nullptr; // секция не на больших страницах
+    }
+    if (!bytes)
+    {
+        struct stat st;
+        if (fstat(h->fd, &st) != 0)
+            return nullptr;
+        bytes = static_cast<size_t>(st.st_size);
+    }
+    const int prot = PROT_READ | ((access & FILE_MAP_WRITE) ? PROT_WRITE : 0);
+    void* p = mmap(nullptr, bytes, prot, MAP_SHARED, h->fd, 0);
+    if (p == MAP_FAILED)
+        return nullptr;
+    for (auto& v : shim::g_views)
+    {
+        if (!v.base)
+        {
+            v = { p, bytes };
+            break;
+        }
+    }
+    return p;
+}
+
+inline BOOL UnmapViewOfFile(LPCVOID p)
+{
+    for (auto& v : shim::g_views)
+    {
+        if (v.base == p)
+        {
+            munmap(v.base, v.size);
+            v = {};
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+inline size_t VirtualQuery(LPCVOID p, MEMORY_BASIC_INFORMATION* mbi, size_t)
+{
+    for (const auto& v : shim::g_views)
+    {
+        if (v.base == p)
+        {
+            mbi->BaseAddress = v.base;
+            mbi->RegionSize  = v.size;
+            return sizeof(*mbi);
+        }
+    }
+    return 0;
+}
+
+inline int swprintf_s(wchar_t* buf, size_t count, const wchar_t* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const int n = vswprintf(buf, count, format, args);
+    va_end(args);
+    return n;
+}
+
+inline HANDLE CreateEventW(void*, BOOL manualReset, BOOL initialState, const wchar_t* name)
+{
+    if (name)
+    {
+        if (manualReset)
+            return nullptr;
+        shim::Handle* h = shim::MapNamedEvent(name, true);
+        if (h && initialState)
+            h->word->store(1);
+        return h;
+    }
+    shim::Handle* h = new shim::Handle{ shim::Kind::Event };
+    h->manualReset = manualReset != FALSE;
+    h->signaled    = initialState != FALSE;
+    return h;
+}
+
+// Только существующее именованное событие, как OpenEventW(EVENT_MODIFY_STATE)
+inline HANDLE OpenEventW(DWORD, BOOL, const wchar_t* name)
+{
+    return name ? shim::MapNamedEvent(name, false) : nullptr;
+}
+
+inline BOOL SetEvent(HANDLE e)
+{
+    shim::Handle* h = static_cast<shim::Handle*>(e);
+    if (h->word)
+    {
+        if (h->word->exchange(1) == 0)
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(h->word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+        return TRUE;
+    }
+    pthread_mutex_lock(&h->mutex);
+    h->signaled = true;
+    pthread_cond_broadcast(&h->cond);
+    pthread_mutex_unlock(&h->mutex);
+    return TRUE;
+}
+
+inline BOOL ResetEvent(HANDLE e)
+{
+    shim::Handle* h = static_cast<shim::Handle*>(e);
+    if (h->word)
+    {
+        h->word->store(0);
+        return TRUE;
+    }
+    pthread_mutex_lock(&h->mutex);
+    h->signaled = false;
+    pthread_mutex_unlock(&h->mutex);
+    return TRUE;
+}
+
+inline HANDLE CreateThread(void*, size_t, DWORD (*proc)(LPVOID), LPVOID param, DWORD, DWORD*)
+{
+    shim::Handle* h = new shim::Handle{ shim::Kind::Thread };
+    h->proc  = proc;
+    h->param = param;
+    if (pthread_create(&h->thread, nullptr, shim::ThreadEntry, h) != 0)
+    {
+        delete h;
+        return nullptr;
+    }
+    return h;
+}
+
+// Событие ждётся до сигнала, поток — до завершения
+inline DWORD WaitForSingleObject(HANDLE obj, DWORD ms)
+{
+    shim::Handle* h = static_cast<shim::Handle*>(obj);
+    if (h->word)
+        return shim::WaitNamedEvent(h, ms) ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+    const timespec deadline = shim::Deadline(ms == INFINITE ? 0 : ms);
+    pthread_mutex_lock(&h->mutex);
+    bool& ready = h->kind == shim::Kind::Thread ? h->finished : h->signaled;
+    int rc = 0;
+    while (!ready && rc != ETIMEDOUT)
+        rc = ms == INFINITE ? pthread_cond_wait(&h->cond, &h->mutex)
+                            : pthread_cond_timedwait(&h->cond, &h->mutex, &deadline);
+    const bool ok = ready;
+    if (ok && h->kind == shim::Kind::Event && !h->manualReset)
+        h->signaled = false;
+    pthread_mutex_unlock(&h->mutex);
+    return ok ? WAIT_OBJECT_0 : WAIT_TIMEOUT;
+}
+
+inline BOOL CloseHandle(HANDLE obj)
+{
+    shim::Handle* h = static_cast<shim::Handle*>(obj);
+    if (!h)
+        return FALSE;
+    if (h->kind == shim::Kind::Mapping)
+        close(h->fd);
+    else if (h->kind == shim::Kind::Thread)
+        pthread_join(h->thread, nullptr);
+    else if (h->word)
+    {
+        munmap(h->word, sizeof(uint32_t));
+        if (h->owner)
+            shm_unlink(h->shmName);
+    }
+    delete h;
+    return TRUE;
+}